@@ -17,6 +17,10 @@ void asm_emit_jit_call_debug(struct util_buffer* p_buf, uint16_t addr);
 void asm_emit_jit_jump_interp(struct util_buffer* p_buf, uint16_t addr);
 void asm_emit_jit_call_inturbo(struct util_buffer* p_buf, uint16_t addr);
 void asm_emit_jit_for_testing(struct util_buffer* p_buf);
+void asm_emit_jit_jsr_pad(struct util_buffer* p_buf,
+                          uint16_t return_addr,
+                          void* p_call_target,
+                          void* p_return_target);
 
 void asm_emit_jit_ADD_CYCLES(struct util_buffer* p_buf, uint8_t value);
 void asm_emit_jit_ADD_ABS(struct util_buffer* p_buf,
@@ -47,6 +51,10 @@ void asm_emit_jit_FLAG_MEM(struct util_buffer* p_buf, uint16_t addr);
 void asm_emit_jit_INC_SCRATCH(struct util_buffer* p_buf);
 void asm_emit_jit_INVERT_CARRY(struct util_buffer* p_buf);
 void asm_emit_jit_JMP_SCRATCH(struct util_buffer* p_buf);
+void asm_emit_jit_JMP_SCRATCH_PREDICTED(struct util_buffer* p_buf,
+                                        uint16_t addr,
+                                        void* p_target);
+void asm_emit_jit_JSR_CALL(struct util_buffer* p_buf, void* p_pad);
 void asm_emit_jit_LDA_Z(struct util_buffer* p_buf);
 void asm_emit_jit_LDX_Z(struct util_buffer* p_buf);
 void asm_emit_jit_LDY_Z(struct util_buffer* p_buf);
@@ -66,8 +74,13 @@ void asm_emit_jit_MODE_IND_SCRATCH_8(struct util_buffer* p_buf);
 void asm_emit_jit_MODE_IND_SCRATCH_16(struct util_buffer* p_buf);
 void asm_emit_jit_MODE_ZPX(struct util_buffer* p_buf, uint8_t value);
 void asm_emit_jit_MODE_ZPY(struct util_buffer* p_buf, uint8_t value);
+void asm_emit_jit_PHA_NO_S(struct util_buffer* p_buf);
+void asm_emit_jit_PHP_NO_S(struct util_buffer* p_buf);
+void asm_emit_jit_PLA_NO_S(struct util_buffer* p_buf);
+void asm_emit_jit_PLP_NO_S(struct util_buffer* p_buf);
 void asm_emit_jit_PULL_16(struct util_buffer* p_buf);
 void asm_emit_jit_PUSH_16(struct util_buffer* p_buf, uint16_t value);
+void asm_emit_jit_RTS_PREDICTED(struct util_buffer* p_buf);
 void asm_emit_jit_SAVE_CARRY(struct util_buffer* p_buf);
 void asm_emit_jit_SAVE_CARRY_INV(struct util_buffer* p_buf);
 void asm_emit_jit_SAVE_OVERFLOW(struct util_buffer* p_buf);
@@ -266,6 +279,7 @@ void asm_emit_jit_STY_scratch(struct util_buffer* p_buf);
 /* Symbols pointing directly to ASM bytes. */
 void asm_jit_compile_trampoline();
 void asm_jit_interp();
+void asm_jit_enter();
 
 void asm_jit_call_compile_trampoline();
 void asm_jit_call_compile_trampoline_END();
@@ -273,6 +287,11 @@ void asm_jit_jump_interp_trampoline();
 void asm_jit_jump_interp_trampoline_pc_patch();
 void asm_jit_jump_interp_trampoline_jump_patch();
 void asm_jit_jump_interp_trampoline_END();
+void asm_jit_jsr_pad();
+void asm_jit_jsr_pad_addr_patch();
+void asm_jit_jsr_pad_call_patch();
+void asm_jit_jsr_pad_jump_patch();
+void asm_jit_jsr_pad_END();
 void asm_jit_check_countdown();
 void asm_jit_check_countdown_count_patch();
 void asm_jit_check_countdown_jump_patch();
@@ -342,6 +361,13 @@ void asm_jit_INVERT_CARRY();
 void asm_jit_INVERT_CARRY_END();
 void asm_jit_JMP_SCRATCH();
 void asm_jit_JMP_SCRATCH_END();
+void asm_jit_JMP_SCRATCH_PREDICTED();
+void asm_jit_JMP_SCRATCH_PREDICTED_addr_patch();
+void asm_jit_JMP_SCRATCH_PREDICTED_jump_patch();
+void asm_jit_JMP_SCRATCH_PREDICTED_END();
+void asm_jit_JSR_CALL();
+void asm_jit_JSR_CALL_jump_patch();
+void asm_jit_JSR_CALL_END();
 void asm_jit_LDA_Z();
 void asm_jit_LDA_Z_END();
 void asm_jit_LDX_Z();
@@ -387,11 +413,21 @@ void asm_jit_MODE_ZPY_8bit();
 void asm_jit_MODE_ZPY_8bit_lea_patch();
 void asm_jit_MODE_ZPY_8bit_END();
 void asm_jit_LOAD_OVERFLOW_END();
+void asm_jit_PHA_NO_S();
+void asm_jit_PHA_NO_S_END();
+void asm_jit_PHP_NO_S();
+void asm_jit_PHP_NO_S_END();
+void asm_jit_PLA_NO_S();
+void asm_jit_PLA_NO_S_END();
+void asm_jit_PLP_NO_S();
+void asm_jit_PLP_NO_S_END();
 void asm_jit_PULL_16();
 void asm_jit_PULL_16_END();
 void asm_jit_PUSH_16();
 void asm_jit_PUSH_16_word_patch();
 void asm_jit_PUSH_16_END();
+void asm_jit_RTS_PREDICTED();
+void asm_jit_RTS_PREDICTED_END();
 void asm_jit_SAVE_CARRY();
 void asm_jit_SAVE_CARRY_END();
 void asm_jit_SAVE_CARRY_INV();
@@ -8,11 +8,21 @@
 #define K_BBC_JIT_BYTES_SHIFT              8
 #define K_BBC_JIT_BYTES_PER_BYTE           (1 << K_BBC_JIT_BYTES_SHIFT)
 #define K_BBC_JIT_ADDR                     0x20000000
-#define K_BBC_JIT_TRAMPOLINE_BYTES         16
+/* Each trampoline slot holds the jump out to the interpreter, followed by the
+ * return pad for a JSR at that address.
+ */
+#define K_BBC_JIT_TRAMPOLINE_BYTES         32
+#define K_BBC_JIT_TRAMPOLINE_PAD_OFFSET    16
 #define K_BBC_JIT_TRAMPOLINES_ADDR         0x31000000
+/* Host stack space for JSR return frames before it is reset. */
+#define K_BBC_JIT_HOST_STACK_BYTES         4096
 #define K_JIT_CONTEXT_OFFSET_JIT_CALLBACK  (K_CONTEXT_OFFSET_DRIVER_END + 0)
 #define K_JIT_CONTEXT_OFFSET_INTURBO       (K_CONTEXT_OFFSET_DRIVER_END + 8)
 #define K_JIT_CONTEXT_OFFSET_JIT_PTRS      (K_CONTEXT_OFFSET_DRIVER_END + 16)
+/* After the jit_ptrs and code_blocks arrays. */
+#define K_JIT_CONTEXT_OFFSET_HOST_SP_BASE  (K_JIT_CONTEXT_OFFSET_JIT_PTRS + \
+                                            (K_6502_ADDR_SPACE_SIZE * 8))
+#define K_JIT_CONTEXT_OFFSET_HOST_SP_FLOOR (K_JIT_CONTEXT_OFFSET_HOST_SP_BASE + 8)
 
 #endif /* BEEBJIT_ASM_JIT_DEFS_H */
 
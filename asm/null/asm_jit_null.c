@@ -52,6 +52,17 @@ asm_emit_jit_for_testing(struct util_buffer* p_buf) {
   (void) p_buf;
 }
 
+void
+asm_emit_jit_jsr_pad(struct util_buffer* p_buf,
+                     uint16_t return_addr,
+                     void* p_call_target,
+                     void* p_return_target) {
+  (void) p_buf;
+  (void) return_addr;
+  (void) p_call_target;
+  (void) p_return_target;
+}
+
 void
 asm_emit_jit_ADD_CYCLES(struct util_buffer* p_buf, uint8_t value) {
   (void) p_buf;
@@ -184,6 +195,21 @@ asm_emit_jit_JMP_SCRATCH(struct util_buffer* p_buf) {
   (void) p_buf;
 }
 
+void
+asm_emit_jit_JMP_SCRATCH_PREDICTED(struct util_buffer* p_buf,
+                                   uint16_t addr,
+                                   void* p_target) {
+  (void) p_buf;
+  (void) addr;
+  (void) p_target;
+}
+
+void
+asm_emit_jit_JSR_CALL(struct util_buffer* p_buf, void* p_pad) {
+  (void) p_buf;
+  (void) p_pad;
+}
+
 void
 asm_emit_jit_LDA_Z(struct util_buffer* p_buf) {
   (void) p_buf;
@@ -280,6 +306,26 @@ asm_emit_jit_MODE_ZPY(struct util_buffer* p_buf, uint8_t value) {
   (void) value;
 }
 
+void
+asm_emit_jit_PHA_NO_S(struct util_buffer* p_buf) {
+  (void) p_buf;
+}
+
+void
+asm_emit_jit_PHP_NO_S(struct util_buffer* p_buf) {
+  (void) p_buf;
+}
+
+void
+asm_emit_jit_PLA_NO_S(struct util_buffer* p_buf) {
+  (void) p_buf;
+}
+
+void
+asm_emit_jit_PLP_NO_S(struct util_buffer* p_buf) {
+  (void) p_buf;
+}
+
 void
 asm_emit_jit_PULL_16(struct util_buffer* p_buf) {
   (void) p_buf;
@@ -291,6 +337,11 @@ asm_emit_jit_PUSH_16(struct util_buffer* p_buf, uint16_t value) {
   (void) value;
 }
 
+void
+asm_emit_jit_RTS_PREDICTED(struct util_buffer* p_buf) {
+  (void) p_buf;
+}
+
 void
 asm_emit_jit_SAVE_CARRY(struct util_buffer* p_buf) {
   (void) p_buf;
@@ -1116,3 +1167,7 @@ asm_emit_jit_STY_scratch(struct util_buffer* p_buf) {
 void
 asm_jit_compile_trampoline() {
 }
+
+void
+asm_jit_enter() {
+}
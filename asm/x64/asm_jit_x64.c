@@ -177,6 +177,31 @@ asm_emit_jit_for_testing(struct util_buffer* p_buf) {
   asm_copy(p_buf, asm_jit_for_testing, asm_jit_for_testing_END);
 }
 
+void
+asm_emit_jit_jsr_pad(struct util_buffer* p_buf,
+                     uint16_t return_addr,
+                     void* p_call_target,
+                     void* p_return_target) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  asm_copy(p_buf, asm_jit_jsr_pad, asm_jit_jsr_pad_END);
+  asm_patch_int(p_buf,
+                offset,
+                asm_jit_jsr_pad,
+                asm_jit_jsr_pad_addr_patch,
+                return_addr);
+  asm_patch_jump(p_buf,
+                 offset,
+                 asm_jit_jsr_pad,
+                 asm_jit_jsr_pad_call_patch,
+                 p_call_target);
+  asm_patch_jump(p_buf,
+                 offset,
+                 asm_jit_jsr_pad,
+                 asm_jit_jsr_pad_jump_patch,
+                 p_return_target);
+}
+
 void
 asm_emit_jit_ADD_CYCLES(struct util_buffer* p_buf, uint8_t value) {
   asm_copy_patch_byte(p_buf, asm_jit_ADD_CYCLES, asm_jit_ADD_CYCLES_END, value);
@@ -353,6 +378,39 @@ asm_emit_jit_JMP_SCRATCH(struct util_buffer* p_buf) {
   asm_copy(p_buf, asm_jit_JMP_SCRATCH, asm_jit_JMP_SCRATCH_END);
 }
 
+void
+asm_emit_jit_JMP_SCRATCH_PREDICTED(struct util_buffer* p_buf,
+                                   uint16_t addr,
+                                   void* p_target) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  asm_copy(p_buf,
+           asm_jit_JMP_SCRATCH_PREDICTED,
+           asm_jit_JMP_SCRATCH_PREDICTED_END);
+  asm_patch_int(p_buf,
+                offset,
+                asm_jit_JMP_SCRATCH_PREDICTED,
+                asm_jit_JMP_SCRATCH_PREDICTED_addr_patch,
+                addr);
+  asm_patch_jump(p_buf,
+                 offset,
+                 asm_jit_JMP_SCRATCH_PREDICTED,
+                 asm_jit_JMP_SCRATCH_PREDICTED_jump_patch,
+                 p_target);
+}
+
+void
+asm_emit_jit_JSR_CALL(struct util_buffer* p_buf, void* p_pad) {
+  size_t offset = util_buffer_get_pos(p_buf);
+
+  asm_copy(p_buf, asm_jit_JSR_CALL, asm_jit_JSR_CALL_END);
+  asm_patch_jump(p_buf,
+                 offset,
+                 asm_jit_JSR_CALL,
+                 asm_jit_JSR_CALL_jump_patch,
+                 p_pad);
+}
+
 void
 asm_emit_jit_LDA_Z(struct util_buffer* p_buf) {
   asm_copy(p_buf, asm_jit_LDA_Z, asm_jit_LDA_Z_END);
@@ -535,6 +593,35 @@ asm_emit_jit_MODE_ZPY(struct util_buffer* p_buf, uint8_t value) {
   }
 }
 
+void
+asm_emit_jit_PHA_NO_S(struct util_buffer* p_buf) {
+  asm_copy(p_buf, asm_jit_PHA_NO_S, asm_jit_PHA_NO_S_END);
+}
+
+void
+asm_emit_jit_PHP_NO_S(struct util_buffer* p_buf) {
+  asm_copy(p_buf,
+           asm_asm_emit_intel_flags_to_scratch,
+           asm_asm_emit_intel_flags_to_scratch_END);
+  asm_copy(p_buf,
+           asm_set_brk_flag_in_scratch,
+           asm_set_brk_flag_in_scratch_END);
+  asm_copy(p_buf, asm_jit_PHP_NO_S, asm_jit_PHP_NO_S_END);
+}
+
+void
+asm_emit_jit_PLA_NO_S(struct util_buffer* p_buf) {
+  asm_copy(p_buf, asm_jit_PLA_NO_S, asm_jit_PLA_NO_S_END);
+}
+
+void
+asm_emit_jit_PLP_NO_S(struct util_buffer* p_buf) {
+  asm_copy(p_buf, asm_jit_PLP_NO_S, asm_jit_PLP_NO_S_END);
+  asm_copy(p_buf,
+           asm_asm_set_intel_flags_from_scratch,
+           asm_asm_set_intel_flags_from_scratch_END);
+}
+
 void
 asm_emit_jit_PULL_16(struct util_buffer* p_buf) {
   asm_copy(p_buf, asm_jit_PULL_16, asm_jit_PULL_16_END);
@@ -552,6 +639,11 @@ asm_emit_jit_PUSH_16(struct util_buffer* p_buf, uint16_t value) {
                 value);
 }
 
+void
+asm_emit_jit_RTS_PREDICTED(struct util_buffer* p_buf) {
+  asm_copy(p_buf, asm_jit_RTS_PREDICTED, asm_jit_RTS_PREDICTED_END);
+}
+
 void
 asm_emit_jit_SAVE_CARRY(struct util_buffer* p_buf) {
   asm_copy(p_buf, asm_jit_SAVE_CARRY, asm_jit_SAVE_CARRY_END);
@@ -20,6 +20,7 @@
 #include "serial.h"
 #include "sound.h"
 #include "state_6502.h"
+#include "state_hash.h"
 #include "tape.h"
 #include "teletext.h"
 #include "timing.h"
@@ -31,6 +32,7 @@
 #include "asm/asm_defs_host.h"
 
 #include <assert.h>
+#include <inttypes.h>
 #include <string.h>
 
 static const size_t k_bbc_os_rom_offset = 0xC000;
@@ -42,6 +44,9 @@ static const size_t k_bbc_andy_size = 0x1000;
 
 static const size_t k_bbc_tick_rate = 2000000; /* 2Mhz. */
 static const size_t k_bbc_default_wakeup_rate = 1000; /* 1ms / 1kHz. */
+static const double k_bbc_min_speed_multiplier = (1.0 / 16.0);
+static const double k_bbc_max_speed_multiplier = 1000.0;
+static const uint32_t k_bbc_default_state_hash_cycles = 2000000; /* 1s. */
 
 /* This data is from b-em, thanks b-em! */
 static const int k_FE_1mhz_array[8] = { 1, 0, 1, 1, 0, 0, 1, 0 };
@@ -97,6 +102,11 @@ struct bbc_struct {
   intptr_t handle_channel_write_bbc;
   intptr_t handle_channel_read_client;
   intptr_t handle_channel_write_client;
+  void (*p_vsync_callback)(void* p,
+                           int do_full_render,
+                           int framing_changed,
+                           uint64_t cycles);
+  void* p_vsync_callback_object;
   uint32_t exit_value;
   intptr_t mem_handle;
   int is_64k_mappings;
@@ -172,10 +182,17 @@ struct bbc_struct {
   struct os_time_sleeper* p_sleeper;
   uint32_t timer_id_cycles;
   uint32_t timer_id_stop_cycles;
+  uint32_t timer_id_state_hash;
+  uint32_t state_hash_cycles;
+  struct state_hash_struct* p_state_hash;
   int32_t timer_id_autoboot;
   uint32_t wakeup_rate;
+  double speed_multiplier;
   uint64_t cycles_per_run_fast;
   uint64_t cycles_per_run_normal;
+  uint64_t cycles_last_run;
+  uint64_t keyboard_poll_cycles_fast;
+  uint64_t keyboard_poll_cycles_normal;
   uint64_t last_time_us;
   uint64_t last_time_us_perf;
   uint64_t last_cycles;
@@ -185,6 +202,10 @@ struct bbc_struct {
   uint64_t last_c1;
   uint64_t last_c2;
   uint32_t advance_cycles_expected;
+  /* Wakeup lateness, for the speed log. */
+  uint64_t num_sleeps;
+  uint64_t sleep_late_us_total;
+  uint64_t sleep_late_us_max;
 
   uint64_t num_hw_reg_hits;
   int log_speed;
@@ -223,6 +244,26 @@ bbc_read_needs_callback(void* p, uint16_t addr) {
   return 0;
 }
 
+static int
+bbc_read_has_snapshot(void* p, uint16_t addr) {
+  struct bbc_struct* p_bbc = (struct bbc_struct*) p;
+
+  /* The VIAs keep their side effect free registers mirrored into the raw
+   * memory under the hardware registers. Not on a Master, where the ROM could
+   * be paged in over the hardware registers.
+   */
+  if (p_bbc->is_master) {
+    return 0;
+  }
+  switch (addr & ~0x1F) {
+  case k_addr_sysvia:
+  case k_addr_uservia:
+    return via_is_register_snapshotted(addr & 0xF);
+  default:
+    return 0;
+  }
+}
+
 static int
 bbc_write_needs_callback(void* p, uint16_t addr) {
   struct bbc_struct* p_bbc = (struct bbc_struct*) p;
@@ -1132,6 +1173,15 @@ bbc_framebuffer_ready_callback(void* p,
 
   struct bbc_struct* p_bbc = (struct bbc_struct*) p;
 
+  /* Synchronous mode: no UI thread, so handle the frame directly, in-thread. */
+  if (p_bbc->p_vsync_callback != NULL) {
+    p_bbc->p_vsync_callback(p_bbc->p_vsync_callback_object,
+                            do_full_render,
+                            framing_changed,
+                            timing_get_total_timer_ticks(p_bbc->p_timing));
+    return;
+  }
+
   message.data[0] = k_message_vsync;
   message.data[1] = do_full_render;
   message.data[2] = framing_changed;
@@ -1197,6 +1247,30 @@ bbc_do_reset_callback(void* p, uint32_t flags) {
       (k_cpu_flag_soft_reset | k_cpu_flag_hard_reset | k_cpu_flag_replay));
 }
 
+static void
+bbc_update_keyboard_poll(struct bbc_struct* p_bbc) {
+  uint64_t poll_cycles;
+
+  /* Not yet running. */
+  if (p_bbc->keyboard_poll_cycles_normal == 0) {
+    return;
+  }
+
+  /* Key events are picked up by a separate, cheap keyboard poll timer, so its
+   * period can be kept short in wall time even if run slices are long.
+   */
+  if (p_bbc->fast_flag) {
+    poll_cycles = p_bbc->keyboard_poll_cycles_fast;
+  } else {
+    poll_cycles = (p_bbc->keyboard_poll_cycles_normal *
+                   p_bbc->speed_multiplier);
+    if (poll_cycles == 0) {
+      poll_cycles = 1;
+    }
+  }
+  keyboard_set_poll_cycles(p_bbc->p_keyboard, poll_cycles);
+}
+
 static void
 bbc_set_fast_mode(void* p, int is_fast) {
   struct cpu_driver* p_cpu_driver;
@@ -1205,6 +1279,7 @@ bbc_set_fast_mode(void* p, int is_fast) {
 
   p_bbc->fast_flag = is_fast;
   sound_set_output_enabled(p_bbc->p_sound, !is_fast);
+  bbc_update_keyboard_poll(p_bbc);
 
   /* In accurate mode, and when not running super fast, we use the interpreter
    * with a special callback to sync 6502 memory writes to the 6845 CRTC memory
@@ -1225,6 +1300,81 @@ bbc_set_fast_mode(void* p, int is_fast) {
                                                      p_bbc->p_video);
 }
 
+static int
+bbc_try_queue_rewind(struct bbc_struct* p_bbc, uint64_t rewind_cycles) {
+  uint64_t rewind_to_cycles;
+  uint64_t cycles = state_6502_get_cycles(p_bbc->p_state_6502);
+  struct cpu_driver* p_cpu_driver = p_bbc->p_cpu_driver;
+
+  if (!keyboard_can_rewind(p_bbc->p_keyboard)) {
+    return 0;
+  }
+
+  rewind_to_cycles = 0;
+  if (cycles > rewind_cycles) {
+    rewind_to_cycles = (cycles - rewind_cycles);
+  }
+  p_bbc->rewind_to_cycles = rewind_to_cycles;
+
+  p_cpu_driver->p_funcs->apply_flags(
+      p_cpu_driver,
+      (k_cpu_flag_hard_reset | k_cpu_flag_replay),
+      0);
+
+  return 1;
+}
+
+static int
+bbc_check_alt_keys(struct bbc_struct* p_bbc) {
+  struct keyboard_struct* p_keyboard = p_bbc->p_keyboard;
+  struct cpu_driver* p_cpu_driver = p_bbc->p_cpu_driver;
+
+  if (keyboard_consume_alt_key_press(p_keyboard, 'F')) {
+    /* Toggle fast mode. */
+    bbc_set_fast_mode(p_bbc, !p_bbc->fast_flag);
+  } else if (keyboard_consume_alt_key_press(p_keyboard, '=')) {
+    /* Double the real time speed. */
+    bbc_set_speed_multiplier(p_bbc, (p_bbc->speed_multiplier * 2));
+  } else if (keyboard_consume_alt_key_press(p_keyboard, '-')) {
+    /* Halve the real time speed. */
+    bbc_set_speed_multiplier(p_bbc, (p_bbc->speed_multiplier / 2));
+  } else if (keyboard_consume_alt_key_press(p_keyboard, 'E')) {
+    /* Exit any in progress replay. */
+    if (keyboard_is_replaying(p_keyboard)) {
+      keyboard_end_replay(p_keyboard);
+    }
+  } else if (keyboard_consume_alt_key_press(p_keyboard, '0')) {
+    disc_drive_cycle_disc(p_bbc->p_drive_0);
+  } else if (keyboard_consume_alt_key_press(p_keyboard, '1')) {
+    disc_drive_cycle_disc(p_bbc->p_drive_1);
+  } else if (keyboard_consume_alt_key_press(p_keyboard, 'T')) {
+    tape_cycle_tape(p_bbc->p_tape);
+  } else if (keyboard_consume_alt_key_press(p_keyboard, 'R')) {
+    /* We're in the middle of some timer callback. Let the CPU driver initiate
+     * the actual reset at a safe time.
+     */
+    p_cpu_driver->p_funcs->apply_flags(p_cpu_driver, k_cpu_flag_hard_reset, 0);
+  } else if (keyboard_consume_alt_key_press(p_keyboard, 'Z')) {
+    /* "undo" -- go back 5 seconds if there is a current capture or replay. */
+    /* TODO: not correct for non-2MHz tick rates. */
+    (void) bbc_try_queue_rewind(p_bbc, (5 * 2000000));
+  } else {
+    return 0;
+  }
+
+  return 1;
+}
+
+static void
+bbc_physical_keyboard_updated_callback(void* p) {
+  struct bbc_struct* p_bbc = (struct bbc_struct*) p;
+
+  /* Check for special alt key combos to change emulator behavior. */
+  while (bbc_check_alt_keys(p_bbc)) {
+    /* Keep going until all combos are consumed. */
+  }
+}
+
 static void
 bbc_reset_callback_baselines(struct bbc_struct* p_bbc) {
   /* Selects 0xFC00 - 0xFFFF which is broader than the needed 0xFC00 - 0xFEFF
@@ -1250,6 +1400,7 @@ bbc_create(int mode,
            int print_flag,
            int fast_flag,
            int accurate_flag,
+           int deterministic_flag,
            int fasttape_flag,
            int test_map_flag,
            const char* p_opt_flags,
@@ -1259,6 +1410,7 @@ bbc_create(int mode,
   struct state_6502* p_state_6502;
   struct debug_struct* p_debug;
   uint32_t cpu_scale_factor;
+  uint32_t sleep_spin_us;
   size_t map_size;
   size_t half_map_size;
   size_t map_offset;
@@ -1273,9 +1425,12 @@ bbc_create(int mode,
   struct bbc_struct* p_bbc = util_mallocz(sizeof(struct bbc_struct));
 
   p_bbc->wakeup_rate = k_bbc_default_wakeup_rate;
+  p_bbc->speed_multiplier = 1.0;
   (void) util_get_u32_option(&p_bbc->wakeup_rate,
                              p_opt_flags,
                              "bbc:wakeup-rate=");
+  sleep_spin_us = 0;
+  (void) util_get_u32_option(&sleep_spin_us, p_opt_flags, "bbc:sleep-spin-us=");
   cpu_scale_factor = 1;
   (void) util_get_u32_option(&cpu_scale_factor,
                              p_opt_flags,
@@ -1309,7 +1464,7 @@ bbc_create(int mode,
     p_bbc->do_video_memory_sync = 0;
   }
 
-  p_bbc->p_sleeper = os_time_create_sleeper();
+  p_bbc->p_sleeper = os_time_create_sleeper(sleep_spin_us);
   p_bbc->last_time_us = 0;
   p_bbc->last_time_us_perf = 0;
   p_bbc->last_cycles = 0;
@@ -1461,6 +1616,7 @@ bbc_create(int mode,
       bbc_write_needs_callback_from;
   p_bbc->memory_access.memory_read_needs_callback = bbc_read_needs_callback;
   p_bbc->memory_access.memory_write_needs_callback = bbc_write_needs_callback;
+  p_bbc->memory_access.memory_read_has_snapshot = bbc_read_has_snapshot;
   p_bbc->memory_access.memory_read_callback = bbc_read_callback;
   p_bbc->memory_access.memory_write_callback = bbc_write_callback;
 
@@ -1470,11 +1626,25 @@ bbc_create(int mode,
   p_bbc->options.p_opt_flags = p_opt_flags;
   p_bbc->options.p_log_flags = p_log_flags;
 
-  /* Accurate mode is implied if fast mode isn't selected. */
-  if (!fast_flag) {
+  /* Accurate mode is implied if fast mode isn't selected, or if deterministic
+   * mode is selected.
+   */
+  if (!fast_flag || deterministic_flag) {
     accurate_flag = 1;
   }
   p_bbc->options.accurate = accurate_flag;
+  p_bbc->options.deterministic = deterministic_flag;
+
+  p_bbc->state_hash_cycles = 0;
+  if (deterministic_flag) {
+    p_bbc->state_hash_cycles = k_bbc_default_state_hash_cycles;
+  }
+  (void) util_get_u32_option(&p_bbc->state_hash_cycles,
+                             p_opt_flags,
+                             "bbc:state-hash-cycles=");
+  if (p_bbc->state_hash_cycles > 0) {
+    p_bbc->p_state_hash = state_hash_create(p_bbc);
+  }
 
   if (accurate_flag) {
     externally_clocked_via = 0;
@@ -1514,6 +1684,12 @@ bbc_create(int mode,
     util_bail("via_create failed");
   }
   via_set_timing_advancer(p_bbc->p_user_via, bbc_timing_advancer, p_bbc);
+  if (!is_master) {
+    via_set_register_snapshot(p_bbc->p_system_via,
+                              (p_bbc->p_mem_raw + k_addr_sysvia));
+    via_set_register_snapshot(p_bbc->p_user_via,
+                              (p_bbc->p_mem_raw + k_addr_uservia));
+  }
 
   p_bbc->p_keyboard = keyboard_create(p_timing, &p_bbc->options);
   if (p_bbc->p_keyboard == NULL) {
@@ -1522,6 +1698,10 @@ bbc_create(int mode,
   keyboard_set_virtual_updated_callback(p_bbc->p_keyboard,
                                         bbc_virtual_keyboard_updated_callback,
                                         p_bbc);
+  keyboard_set_physical_updated_callback(
+      p_bbc->p_keyboard,
+      bbc_physical_keyboard_updated_callback,
+      p_bbc);
   keyboard_set_fast_mode_callback(p_bbc->p_keyboard, bbc_set_fast_mode, p_bbc);
 
   p_bbc->p_sound = sound_create(synchronous_sound, p_timing, &p_bbc->options);
@@ -1658,6 +1838,9 @@ bbc_destroy(struct bbc_struct* p_bbc) {
   }
   disc_drive_destroy(p_bbc->p_drive_0);
   disc_drive_destroy(p_bbc->p_drive_1);
+  if (p_bbc->p_state_hash != NULL) {
+    state_hash_destroy(p_bbc->p_state_hash);
+  }
   state_6502_destroy(p_bbc->p_state_6502);
   timing_destroy(p_bbc->p_timing);
   os_alloc_free_mapping(p_bbc->p_mapping_raw);
@@ -2070,8 +2253,9 @@ bbc_do_sleep(struct bbc_struct* p_bbc,
 
   /* If we're synchronously writing to the sound driver at the same time the
    * CPU executes, the timing is locked to the blocking sound driver write.
+   * Non-blocking synchronous sound instead follows the timing set here.
    */
-  if (sound_is_active(p_sound) && sound_is_synchronous(p_sound)) {
+  if (sound_is_blocking(p_sound)) {
     return;
   }
 
@@ -2081,7 +2265,14 @@ bbc_do_sleep(struct bbc_struct* p_bbc,
   p_bbc->last_time_us = next_wakeup_time_us;
 
   if (spare_time_us >= 0) {
-    os_time_sleeper_sleep_us(p_bbc->p_sleeper, spare_time_us);
+    uint64_t wakeup_time_us =
+        os_time_sleeper_sleep_until_us(p_bbc->p_sleeper, next_wakeup_time_us);
+    uint64_t late_us = (wakeup_time_us - next_wakeup_time_us);
+    p_bbc->num_sleeps++;
+    p_bbc->sleep_late_us_total += late_us;
+    if (late_us > p_bbc->sleep_late_us_max) {
+      p_bbc->sleep_late_us_max = late_us;
+    }
   } else {
     /* Missed a tick.
      * In all cases, don't sleep.
@@ -2121,6 +2312,7 @@ bbc_do_log_speed(struct bbc_struct* p_bbc, uint64_t curr_time_us) {
   double hw_reg_ps;
   double c1_ps;
   double c2_ps;
+  double sleep_late_us_avg;
 
   struct video_struct* p_video = p_bbc->p_video;
   struct cpu_driver* p_cpu_driver = p_bbc->p_cpu_driver;
@@ -2153,16 +2345,24 @@ bbc_do_log_speed(struct bbc_struct* p_bbc, uint64_t curr_time_us) {
   hw_reg_ps = (delta_hw_reg_hits / delta_s);
   c1_ps = (delta_c1 / delta_s);
   c2_ps = (delta_c2 / delta_s);
+  sleep_late_us_avg = 0.0;
+  if (p_bbc->num_sleeps > 0) {
+    sleep_late_us_avg = ((double) p_bbc->sleep_late_us_total /
+                         p_bbc->num_sleeps);
+  }
 
   log_do_log(k_log_perf,
              k_log_info,
-             " %.1f fps, %.1f Mhz, %.1f crtc/s %.1f hw/s %.1f c1/s %.1f c2/s",
+             " %.1f fps, %.1f Mhz, %.1f crtc/s %.1f hw/s %.1f c1/s %.1f c2/s"
+             ", sleep late %.1fus avg %"PRIu64"us max",
              fps,
              mhz,
              crtc_ps,
              hw_reg_ps,
              c1_ps,
-             c2_ps);
+             c2_ps,
+             sleep_late_us_avg,
+             p_bbc->sleep_late_us_max);
 
   p_bbc->last_cycles = curr_cycles;
   p_bbc->last_frames = curr_frames;
@@ -2171,83 +2371,28 @@ bbc_do_log_speed(struct bbc_struct* p_bbc, uint64_t curr_time_us) {
   p_bbc->last_time_us_perf = curr_time_us;
   p_bbc->last_c1 = curr_c1;
   p_bbc->last_c2 = curr_c2;
-}
-
-static int
-bbc_try_queue_rewind(struct bbc_struct* p_bbc, uint64_t rewind_cycles) {
-  uint64_t rewind_to_cycles;
-  uint64_t cycles = state_6502_get_cycles(p_bbc->p_state_6502);
-  struct cpu_driver* p_cpu_driver = p_bbc->p_cpu_driver;
-
-  if (!keyboard_can_rewind(p_bbc->p_keyboard)) {
-    return 0;
-  }
-
-  rewind_to_cycles = 0;
-  if (cycles > rewind_cycles) {
-    rewind_to_cycles = (cycles - rewind_cycles);
-  }
-  p_bbc->rewind_to_cycles = rewind_to_cycles;
-
-  p_cpu_driver->p_funcs->apply_flags(
-      p_cpu_driver,
-      (k_cpu_flag_hard_reset | k_cpu_flag_replay),
-      0);
-
-  return 1;
-}
-
-static inline void
-bbc_check_alt_keys(struct bbc_struct* p_bbc) {
-  struct keyboard_struct* p_keyboard = p_bbc->p_keyboard;
-  struct cpu_driver* p_cpu_driver = p_bbc->p_cpu_driver;
-
-  if (keyboard_consume_alt_key_press(p_keyboard, 'F')) {
-    /* Toggle fast mode. */
-    bbc_set_fast_mode(p_bbc, !p_bbc->fast_flag);
-  } else if (keyboard_consume_alt_key_press(p_keyboard, 'E')) {
-    /* Exit any in progress replay. */
-    if (keyboard_is_replaying(p_keyboard)) {
-      keyboard_end_replay(p_keyboard);
-    }
-  } else if (keyboard_consume_alt_key_press(p_keyboard, '0')) {
-    disc_drive_cycle_disc(p_bbc->p_drive_0);
-  } else if (keyboard_consume_alt_key_press(p_keyboard, '1')) {
-    disc_drive_cycle_disc(p_bbc->p_drive_1);
-  } else if (keyboard_consume_alt_key_press(p_keyboard, 'T')) {
-    tape_cycle_tape(p_bbc->p_tape);
-  } else if (keyboard_consume_alt_key_press(p_keyboard, 'R')) {
-    /* We're in the middle of some timer callback. Let the CPU driver initiate
-     * the actual reset at a safe time.
-     */
-    p_cpu_driver->p_funcs->apply_flags(p_cpu_driver, k_cpu_flag_hard_reset, 0);
-  } else if (keyboard_consume_alt_key_press(p_keyboard, 'Z')) {
-    /* "undo" -- go back 5 seconds if there is a current capture or replay. */
-    /* TODO: not correct for non-2MHz tick rates. */
-    (void) bbc_try_queue_rewind(p_bbc, (5 * 2000000));
-  }
+  p_bbc->num_sleeps = 0;
+  p_bbc->sleep_late_us_total = 0;
+  p_bbc->sleep_late_us_max = 0;
 }
 
 static void
 bbc_cycles_timer_callback(void* p) {
   uint64_t delta_us;
+  uint64_t sleep_us;
+  uint64_t emulated_delta_us;
   uint64_t cycles_next_run;
   int64_t refreshed_time;
 
   struct bbc_struct* p_bbc = (struct bbc_struct*) p;
   struct timing_struct* p_timing = p_bbc->p_timing;
-  struct keyboard_struct* p_keyboard = p_bbc->p_keyboard;
   uint64_t curr_time_us = os_time_get_us();
   uint64_t last_time_us = p_bbc->last_time_us;
 
-  /* Pull physical key events from system thread, always.
-   * If this ends up updating the virtual keyboard, this call also syncs
-   * interrupts and checks for BREAK.
+  /* NOTE: physical key events are not pulled from the system thread here.
+   * The keyboard has its own poll timer for that, so that the run slice
+   * length doesn't affect key latency.
    */
-  keyboard_read_queue(p_keyboard);
-
-  /* Check for special alt key combos to change emulator behavior. */
-  bbc_check_alt_keys(p_bbc);
 
   p_bbc->last_time_us = curr_time_us;
 
@@ -2262,11 +2407,28 @@ bbc_cycles_timer_callback(void* p) {
      * specifically some fraction of a 50Hz frame, a highly responsive system
      * results.
      */
-    cycles_next_run = p_bbc->cycles_per_run_normal;
     delta_us = (1000000 / p_bbc->wakeup_rate);
+    if (p_bbc->options.deterministic) {
+      /* The run slice must not vary, so go faster by sleeping less. */
+      cycles_next_run = p_bbc->cycles_per_run_normal;
+      sleep_us = (delta_us / p_bbc->speed_multiplier);
+    } else {
+      cycles_next_run = (p_bbc->cycles_per_run_normal *
+                         p_bbc->speed_multiplier);
+      if (cycles_next_run == 0) {
+        cycles_next_run = 1;
+      }
+      sleep_us = delta_us;
+    }
 
     /* This may adjust p_bbc->last_time_us to maintain smooth timing. */
-    bbc_do_sleep(p_bbc, last_time_us, curr_time_us, delta_us);
+    bbc_do_sleep(p_bbc, last_time_us, curr_time_us, sleep_us);
+  } else if (p_bbc->options.deterministic) {
+    /* Fast mode, but keep the same run slice as slow mode. serial_tick() below
+     * is called per slice and its effect must not depend on the current mode.
+     */
+    cycles_next_run = p_bbc->cycles_per_run_normal;
+    delta_us = 0;
   } else {
     /* Fast mode.
      * Fast mode is where the system executes as fast as the host CPU can
@@ -2285,12 +2447,30 @@ bbc_cycles_timer_callback(void* p) {
 
   assert(refreshed_time > 0);
 
+  /* In deterministic mode, nothing may observe the wall clock. Use the
+   * emulated time for the slice just finished instead.
+   */
+  if (p_bbc->options.deterministic) {
+    delta_us = ((p_bbc->cycles_last_run * 1000000) / k_bbc_tick_rate);
+    p_bbc->cycles_last_run = cycles_next_run;
+  }
+
   /* Provide the wall time delta to various modules.
-   * In inaccurate modes, this wall time may be used to advance state.
+   * In inaccurate modes, this wall time may be used to advance state, so it
+   * is scaled by any real time speed multiplier. Accurate mode video only
+   * uses it to pace painting, which stays at real time 50Hz.
    */
-  via_apply_wall_time_delta(p_bbc->p_system_via, delta_us);
-  via_apply_wall_time_delta(p_bbc->p_user_via, delta_us);
-  video_apply_wall_time_delta(p_bbc->p_video, delta_us);
+  emulated_delta_us = delta_us;
+  if (!p_bbc->fast_flag && !p_bbc->options.deterministic) {
+    emulated_delta_us *= p_bbc->speed_multiplier;
+  }
+  via_apply_wall_time_delta(p_bbc->p_system_via, emulated_delta_us);
+  via_apply_wall_time_delta(p_bbc->p_user_via, emulated_delta_us);
+  if (p_bbc->options.accurate) {
+    video_apply_wall_time_delta(p_bbc->p_video, delta_us);
+  } else {
+    video_apply_wall_time_delta(p_bbc->p_video, emulated_delta_us);
+  }
 
   /* Prod the sound module in case it's in synchronous mode. */
   sound_tick(p_bbc->p_sound);
@@ -2305,6 +2485,22 @@ bbc_cycles_timer_callback(void* p) {
   }
 }
 
+static void
+bbc_state_hash_timer_callback(void* p) {
+  int64_t refreshed_time;
+
+  struct bbc_struct* p_bbc = (struct bbc_struct*) p;
+  struct timing_struct* p_timing = p_bbc->p_timing;
+
+  (void) timing_adjust_timer_value(p_timing,
+                                   &refreshed_time,
+                                   p_bbc->timer_id_state_hash,
+                                   p_bbc->state_hash_cycles);
+
+  state_hash_checkpoint(p_bbc->p_state_hash,
+                        timing_get_total_timer_ticks(p_timing));
+}
+
 static void
 bbc_start_timer_tick(struct bbc_struct* p_bbc) {
   uint32_t option_cycles_per_run;
@@ -2341,6 +2537,12 @@ bbc_start_timer_tick(struct bbc_struct* p_bbc) {
 
   p_bbc->cycles_per_run_fast = (speed / p_bbc->wakeup_rate);
 
+  /* Poll for key events at the wakeup rate in both modes, regardless of any
+   * custom run slice length.
+   */
+  p_bbc->keyboard_poll_cycles_normal = p_bbc->cycles_per_run_normal;
+  p_bbc->keyboard_poll_cycles_fast = p_bbc->cycles_per_run_fast;
+
   if (util_get_u32_option(&option_cycles_per_run,
                           p_bbc->options.p_opt_flags,
                           "bbc:cycles-per-run=")) {
@@ -2348,16 +2550,24 @@ bbc_start_timer_tick(struct bbc_struct* p_bbc) {
   }
 
   (void) timing_start_timer_with_value(p_timing, p_bbc->timer_id_cycles, 1);
+  p_bbc->cycles_last_run = 1;
+
+  /* Periodic state hashes let two runs be compared for divergence. */
+  if (p_bbc->state_hash_cycles > 0) {
+    p_bbc->timer_id_state_hash =
+        timing_register_timer(p_timing, bbc_state_hash_timer_callback, p_bbc);
+    (void) timing_start_timer_with_value(p_timing,
+                                         p_bbc->timer_id_state_hash,
+                                         p_bbc->state_hash_cycles);
+  }
 
   p_bbc->last_time_us = os_time_get_us();
 }
 
-static void*
-bbc_cpu_thread(void* p) {
+static void
+bbc_cpu_run(struct bbc_struct* p_bbc) {
   int exited;
-  struct bbc_message message;
 
-  struct bbc_struct* p_bbc = (struct bbc_struct*) p;
   struct cpu_driver* p_cpu_driver = p_bbc->p_cpu_driver;
 
   bbc_start_timer_tick(p_bbc);
@@ -2372,6 +2582,15 @@ bbc_cpu_thread(void* p) {
 
   p_bbc->running = 0;
   p_bbc->exit_value = p_cpu_driver->p_funcs->get_exit_value(p_cpu_driver);
+}
+
+static void*
+bbc_cpu_thread(void* p) {
+  struct bbc_message message;
+
+  struct bbc_struct* p_bbc = (struct bbc_struct*) p;
+
+  bbc_cpu_run(p_bbc);
 
   message.data[0] = k_message_exited;
   bbc_cpu_send_message(p_bbc, &message);
@@ -2381,6 +2600,8 @@ bbc_cpu_thread(void* p) {
 
 void
 bbc_run_async(struct bbc_struct* p_bbc) {
+  assert(p_bbc->p_vsync_callback == NULL);
+
   p_bbc->p_thread_cpu = os_thread_create(bbc_cpu_thread, p_bbc);
 
   assert(!p_bbc->thread_allocated);
@@ -2392,6 +2613,21 @@ bbc_run_async(struct bbc_struct* p_bbc) {
   sound_start_playing(p_bbc->p_sound);
 }
 
+void
+bbc_run_sync(struct bbc_struct* p_bbc) {
+  assert(!p_bbc->thread_allocated);
+  assert(!p_bbc->running);
+
+  p_bbc->running = 1;
+
+  sound_start_playing(p_bbc->p_sound);
+
+  /* Runs the CPU on the calling thread until exit. Vsync notifications go to
+   * the vsync callback, if any, instead of a UI thread.
+   */
+  bbc_cpu_run(p_bbc);
+}
+
 uint32_t
 bbc_get_run_result(struct bbc_struct* p_bbc) {
   volatile uint32_t* p_ret = &p_bbc->exit_value;
@@ -2415,6 +2651,17 @@ bbc_set_channel_handles(struct bbc_struct* p_bbc,
   p_bbc->handle_channel_write_client = handle_channel_write_client;
 }
 
+void
+bbc_set_vsync_callback(struct bbc_struct* p_bbc,
+                       void (*p_vsync_callback)(void* p,
+                                                int do_full_render,
+                                                int framing_changed,
+                                                uint64_t cycles),
+                       void* p_vsync_callback_object) {
+  p_bbc->p_vsync_callback = p_vsync_callback;
+  p_bbc->p_vsync_callback_object = p_vsync_callback_object;
+}
+
 void
 bbc_add_disc(struct bbc_struct* p_bbc,
              const char* p_filename,
@@ -2509,6 +2756,35 @@ bbc_set_autoboot(struct bbc_struct* p_bbc, int autoboot_flag) {
   p_bbc->autoboot_flag = autoboot_flag;
 }
 
+void
+bbc_set_state_hash_log(struct bbc_struct* p_bbc, const char* p_file_name) {
+  if (p_bbc->p_state_hash == NULL) {
+    p_bbc->state_hash_cycles = k_bbc_default_state_hash_cycles;
+    p_bbc->p_state_hash = state_hash_create(p_bbc);
+  }
+  state_hash_set_log_file(p_bbc->p_state_hash, p_file_name);
+}
+
+void
+bbc_set_speed_multiplier(struct bbc_struct* p_bbc, double multiplier) {
+  if (multiplier < k_bbc_min_speed_multiplier) {
+    multiplier = k_bbc_min_speed_multiplier;
+  } else if (multiplier > k_bbc_max_speed_multiplier) {
+    multiplier = k_bbc_max_speed_multiplier;
+  }
+
+  p_bbc->speed_multiplier = multiplier;
+
+  /* Sound pitch, painting rate and key polling all follow along, so that a
+   * change of speed at runtime is smooth.
+   */
+  sound_set_speed_multiplier(p_bbc->p_sound, multiplier);
+  video_set_paint_throttled(p_bbc->p_video, (multiplier > 1.0));
+  bbc_update_keyboard_poll(p_bbc);
+
+  log_do_log(k_log_misc, k_log_info, "speed multiplier %.3f", multiplier);
+}
+
 void
 bbc_set_commands(struct bbc_struct* p_bbc, const char* p_commands) {
   debug_set_commands(p_bbc->p_debug, p_commands);
@@ -47,6 +47,7 @@ struct bbc_struct* bbc_create(int mode,
                               int print_flag,
                               int fast_flag,
                               int accurate_flag,
+                              int deterministic_flag,
                               int fasttape_flag,
                               int test_map_flag,
                               const char* p_opt_flags,
@@ -82,6 +83,8 @@ void bbc_add_raw_disc(struct bbc_struct* p_bbc,
 void bbc_add_tape(struct bbc_struct* p_bbc, const char* p_file_name);
 void bbc_set_stop_cycles(struct bbc_struct* p_bbc, uint64_t cycles);
 void bbc_set_autoboot(struct bbc_struct* p_bbc, int autoboot_flag);
+void bbc_set_speed_multiplier(struct bbc_struct* p_bbc, double multiplier);
+void bbc_set_state_hash_log(struct bbc_struct* p_bbc, const char* p_file_name);
 void bbc_set_commands(struct bbc_struct* p_bbc, const char* p_commands);
 
 struct cpu_driver* bbc_get_cpu_driver(struct bbc_struct* p_bbc);
@@ -102,6 +105,7 @@ void bbc_set_registers(struct bbc_struct* p_bbc,
 void bbc_set_pc(struct bbc_struct* p_bbc, uint16_t pc);
 
 void bbc_run_async(struct bbc_struct* p_bbc);
+void bbc_run_sync(struct bbc_struct* p_bbc);
 uint32_t bbc_get_run_result(struct bbc_struct* p_bbc);
 int bbc_check_do_break(struct bbc_struct* p_bbc);
 
@@ -145,6 +149,12 @@ void bbc_set_channel_handles(struct bbc_struct* p_bbc,
                              intptr_t handle_channel_write_bbc,
                              intptr_t handle_channel_read_client,
                              intptr_t handle_channel_write_client);
+void bbc_set_vsync_callback(struct bbc_struct* p_bbc,
+                            void (*p_vsync_callback)(void* p,
+                                                     int do_full_render,
+                                                     int framing_changed,
+                                                     uint64_t cycles),
+                            void* p_vsync_callback_object);
 
 struct bbc_message {
   uint64_t data[4];
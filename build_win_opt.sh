@@ -5,11 +5,12 @@
 x86_64-w64-mingw32-gcc -Wall -W -Werror \
     -Wno-unknown-warning-option -Wno-address-of-packed-member \
     -O3 -DNDEBUG -flto -o beebjit.exe \
-    main.c config.c bbc.c defs_6502.c state.c video.c via.c \
+    main.c config.c bbc.c defs_6502.c state.c state_hash.c video.c via.c \
     emit_6502.c interp.c inturbo.c state_6502.c sound.c timing.c \
     jit_compiler.c cpu_driver.c \
     jit_optimizer.c jit_opcode.c keyboard.c \
-    teletext.c render.c serial.c log.c test.c tape.c adc.c cmos.c \
+    teletext.c render.c render_scale.c \
+    serial.c log.c test.c tape.c adc.c cmos.c \
     intel_fdc.c wd_fdc.c \
     disc_drive.c disc.c ibm_disc_format.c disc_tool.c \
     disc_fsd.c disc_hfe.c disc_ssd.c disc_adl.c \
@@ -28,6 +28,15 @@ cpu_driver_get_address_info_dummy(struct cpu_driver* p_cpu_driver,
   return "    ";
 }
 
+static int
+cpu_driver_request_code_dump_dummy(struct cpu_driver* p_cpu_driver,
+                                   uint16_t addr) {
+  (void) p_cpu_driver;
+  (void) addr;
+
+  return 0;
+}
+
 static void
 cpu_driver_get_custom_counters_dummy(struct cpu_driver* p_cpu_driver,
                                      uint64_t* p_c1,
@@ -185,6 +194,7 @@ cpu_driver_alloc(int mode,
   p_funcs->set_exit_value = cpu_driver_set_exit_value_default;
   p_funcs->memory_range_invalidate = cpu_driver_memory_range_invalidate_dummy;
   p_funcs->get_address_info = cpu_driver_get_address_info_dummy;
+  p_funcs->request_code_dump = cpu_driver_request_code_dump_dummy;
   p_funcs->get_custom_counters = cpu_driver_get_custom_counters_dummy;
   if (is_65c12) {
     p_funcs->get_opcode_maps = cpu_driver_get_65c12_opcode_maps;
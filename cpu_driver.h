@@ -45,6 +45,8 @@ struct cpu_driver_funcs {
                                   uint16_t addr,
                                   uint32_t len);
   char* (*get_address_info)(struct cpu_driver* p_cpu_driver, uint16_t addr);
+  /* Returns zero if the driver has no generated code to dump. */
+  int (*request_code_dump)(struct cpu_driver* p_cpu_driver, uint16_t addr);
   void (*get_custom_counters)(struct cpu_driver* p_cpu_driver,
                               uint64_t* p_c1,
                               uint64_t* p_c2);
@@ -1551,6 +1551,14 @@ debug_callback(struct cpu_driver* p_cpu_driver, int do_irq) {
                (parse_int >= 0) &&
                (parse_int < k_max_break)) {
       debug_clear_breakpoint(p_debug, parse_int);
+    } else if (sscanf(input_buf, "jd %"PRIx32, &parse_int) == 1) {
+      if (p_cpu_driver->p_funcs->request_code_dump(p_cpu_driver,
+                                                   (uint16_t) parse_int)) {
+        (void) printf("block at $%.4"PRIX16" dumps to log on next compile\n",
+                      (uint16_t) parse_int);
+      } else {
+        (void) printf("no generated code in this CPU mode\n");
+      }
     } else if ((sscanf(input_buf, "bop %"PRIx32, &parse_int) == 1) &&
                (parse_int >= 0) &&
                (parse_int < 256)) {
@@ -1800,6 +1808,7 @@ debug_callback(struct cpu_driver* p_cpu_driver, int do_irq) {
   "cs                 : clear stats collected\n"
   "t                  : trap into gdb\n"
   "breakat <c>        : break at <c> cycles\n"
+  "jd <a>             : recompile JIT block at <a>, dumping it to the log\n"
   "keydown <k>        : simulate key press <k>\n"
   "keyup <k>          : simulate key release <k>\n"
   "ss <f>             : save state to BEM file <f> (deprecated)\n"
@@ -21,6 +21,7 @@
 
 #include <assert.h>
 #include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -39,6 +40,9 @@ struct jit_struct {
   uint32_t jit_ptrs[k_6502_addr_space_size];
   /* 6502 address -> code block. */
   int32_t code_blocks[k_6502_addr_space_size];
+  /* Host stack bounds for JSR return frames, set up on JIT entry. */
+  void* p_host_sp_base;
+  void* p_host_sp_floor;
 
   /* Fields not referenced by JIT'ed code. */
   struct os_alloc_mapping* p_mapping_jit;
@@ -51,6 +55,8 @@ struct jit_struct {
   uint32_t jit_ptr_no_code;
   uint32_t jit_ptr_dynamic_operand;
   uint8_t jit_invalidation_sequence[2];
+  /* JIT code space and trampolines are set up lazily, per 6502 page. */
+  uint8_t is_page_populated[k_6502_addr_space_size / 256];
   uint8_t* p_opcode_types;
   uint8_t* p_opcode_modes;
   uint8_t* p_opcode_mem;
@@ -78,6 +84,48 @@ jit_invalidate_host_address(struct jit_struct* p_jit, uint8_t* p_jit_ptr) {
   p_jit_ptr[1] = p_jit->jit_invalidation_sequence[1];
 }
 
+static void
+jit_populate_page(struct jit_struct* p_jit, uint8_t page_6502) {
+  uint32_t i;
+
+  uint16_t addr_6502 = (page_6502 << 8);
+  uint8_t* p_jit_page = jit_get_jit_block_host_address(p_jit, addr_6502);
+  size_t jit_page_size = (256 * K_BBC_JIT_BYTES_PER_BYTE);
+  uint8_t* p_trampolines_page = (p_jit->p_jit_trampolines +
+                                 (addr_6502 * K_BBC_JIT_TRAMPOLINE_BYTES));
+  size_t trampolines_page_size = (256 * K_BBC_JIT_TRAMPOLINE_BYTES);
+  struct util_buffer* p_temp_buf = p_jit->p_temp_buf;
+
+  assert(!p_jit->is_page_populated[page_6502]);
+
+  os_alloc_make_mapping_read_write_exec(p_jit_page, jit_page_size);
+  os_alloc_make_mapping_read_write_exec(p_trampolines_page,
+                                        trampolines_page_size);
+  /* Fill with int3. */
+  (void) memset(p_jit_page, '\xcc', jit_page_size);
+  (void) memset(p_trampolines_page, '\xcc', trampolines_page_size);
+
+  for (i = 0; i < 256; ++i) {
+    jit_invalidate_host_address(p_jit,
+                                (p_jit_page + (i * K_BBC_JIT_BYTES_PER_BYTE)));
+    util_buffer_setup(
+        p_temp_buf,
+        (p_trampolines_page + (i * K_BBC_JIT_TRAMPOLINE_BYTES)),
+        K_BBC_JIT_TRAMPOLINE_PAD_OFFSET);
+    asm_emit_jit_jump_interp_trampoline(p_temp_buf, (addr_6502 + i));
+  }
+
+  p_jit->is_page_populated[page_6502] = 1;
+}
+
+static inline void
+jit_ensure_page_populated(struct jit_struct* p_jit, uint16_t addr_6502) {
+  uint8_t page_6502 = (addr_6502 >> 8);
+  if (!p_jit->is_page_populated[page_6502]) {
+    jit_populate_page(p_jit, page_6502);
+  }
+}
+
 static inline int
 jit_has_6502_code(struct jit_struct* p_jit, uint16_t addr_6502) {
   if (p_jit->jit_ptrs[addr_6502] == p_jit->jit_ptr_no_code) {
@@ -89,12 +137,15 @@ jit_has_6502_code(struct jit_struct* p_jit, uint16_t addr_6502) {
 static void*
 jit_get_block_host_address_callback(void* p, uint16_t addr_6502) {
   struct jit_struct* p_jit = (struct jit_struct*) p;
+  /* The compiler may be about to write here. */
+  jit_ensure_page_populated(p_jit, addr_6502);
   return jit_get_jit_block_host_address(p_jit, addr_6502);
 }
 
 static void*
 jit_get_trampoline_host_address_callback(void* p, uint16_t addr_6502) {
   struct jit_struct* p_jit = (struct jit_struct*) p;
+  jit_ensure_page_populated(p_jit, addr_6502);
   return (p_jit->p_jit_trampolines + (addr_6502 * K_BBC_JIT_TRAMPOLINE_BYTES));
 }
 
@@ -276,10 +327,14 @@ jit_enter(struct cpu_driver* p_cpu_driver) {
   struct state_6502* p_state_6502 = p_cpu_driver->abi.p_state_6502;
   uint16_t addr_6502 = state_6502_get_pc(p_state_6502);
   struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
-  uint8_t* p_start_addr = jit_get_jit_block_host_address(p_jit, addr_6502);
   void* p_mem_base = (void*) K_BBC_MEM_READ_IND_ADDR;
 
-  uint_start_addr = (uint32_t) (size_t) p_start_addr;
+  jit_ensure_page_populated(p_jit, addr_6502);
+
+  /* The entry stub sets up the host stack for JSR return frames, then jumps
+   * to the block for the 6502 PC.
+   */
+  uint_start_addr = (uint32_t) (size_t) asm_jit_enter;
 
   countdown = timing_get_countdown(p_timing);
 
@@ -379,7 +434,10 @@ jit_memory_range_invalidate(struct cpu_driver* p_cpu_driver,
 
   for (i = addr; i < addr_end; ++i) {
     jit_invalidate_code_at_address(p_jit, i);
-    jit_invalidate_host_block_address(p_jit, i);
+    /* Pages not yet populated are already fully invalidated. */
+    if (p_jit->is_page_populated[i >> 8]) {
+      jit_invalidate_host_block_address(p_jit, i);
+    }
     p_jit->jit_ptrs[i] = p_jit->jit_ptr_no_code;
     p_jit->code_blocks[i] = -1;
   }
@@ -402,6 +460,26 @@ jit_get_address_info(struct cpu_driver* p_cpu_driver, uint16_t addr) {
   return block_addr_buf;
 }
 
+static int
+jit_request_code_dump(struct cpu_driver* p_cpu_driver, uint16_t addr) {
+  struct jit_struct* p_jit = (struct jit_struct*) p_cpu_driver;
+  int32_t block_addr_6502 = jit_6502_code_block_from_6502_pc(p_jit, addr);
+
+  if (block_addr_6502 == -1) {
+    block_addr_6502 = addr;
+  }
+  jit_compiler_set_dump_addr(p_jit->p_compiler, (uint16_t) block_addr_6502);
+
+  /* Recompile the block next time it is entered. Only the block entry point
+   * is invalidated, so this doesn't count as self-modified code.
+   */
+  if (p_jit->is_page_populated[block_addr_6502 >> 8]) {
+    jit_invalidate_host_block_address(p_jit, (uint16_t) block_addr_6502);
+  }
+
+  return 1;
+}
+
 static void
 jit_get_custom_counters(struct cpu_driver* p_cpu_driver,
                         uint64_t* p_c1,
@@ -583,6 +661,21 @@ jit_compile(struct jit_struct* p_jit,
     clear_ptrs_addr_6502++;
   }
 
+  if (jit_compiler_has_unchecked_code_writes(p_compiler)) {
+    log_do_log(k_log_jit,
+               k_log_info,
+               "compiled code @$%.4X in page with unchecked writes",
+               addr_6502);
+
+    /* Invalidate all existing compiled code, including the block just
+     * compiled, because some of it writes to these pages without checking for
+     * self-modified code.
+     */
+    jit_memory_range_invalidate(&p_jit->driver,
+                                0,
+                                (k_6502_addr_space_size - 1));
+  }
+
   if (p_jit->log_compile) {
     const char* p_text;
     uint16_t addr_6502_end = (addr_6502 + bytes_6502_compiled - 1);
@@ -654,6 +747,21 @@ fault_reraise(void* p_rip, void* p_addr) {
   os_fault_bail();
 }
 
+static struct jit_struct*
+jit_get_jit_from_fault(void* p_fault_rip,
+                       void* p_fault_addr,
+                       uintptr_t host_rdi) {
+  struct jit_struct* p_jit = (struct jit_struct*) host_rdi;
+  /* Sanity check it is really a jit struct. */
+  if (p_jit->p_compile_callback != jit_compile) {
+    fault_reraise(p_fault_rip, p_fault_addr);
+  }
+  if (p_jit->p_jit_trampolines != (void*) K_BBC_JIT_TRAMPOLINES_ADDR) {
+    fault_reraise(p_fault_rip, p_fault_addr);
+  }
+  return p_jit;
+}
+
 static void
 jit_handle_fault(uintptr_t* p_host_rip,
                  uintptr_t host_fault_addr,
@@ -680,9 +788,25 @@ jit_handle_fault(uintptr_t* p_host_rip,
     fault_reraise(p_fault_rip, p_fault_addr);
   }
 
-  /* Fault in instruction fetch would be bad! */
+  /* Fault in instruction fetch is only expected for a jump into a page of
+   * the code space that hasn't been populated yet. Populate it and retry.
+   */
   if (is_exec) {
-    fault_reraise(p_fault_rip, p_fault_addr);
+    uint8_t page_6502;
+    p_jit = jit_get_jit_from_fault(p_fault_rip, p_fault_addr, host_rdi);
+    if ((p_fault_addr < (void*) K_BBC_JIT_ADDR) ||
+        (p_fault_addr >= p_jit_end)) {
+      fault_reraise(p_fault_rip, p_fault_addr);
+    }
+    page_6502 = (jit_6502_block_addr_from_host(p_jit, p_fault_addr) >> 8);
+    if (p_jit->is_page_populated[page_6502]) {
+      fault_reraise(p_fault_rip, p_fault_addr);
+    }
+    /* NOTE -- populating calls mprotect() and memset(), which are fine in
+     * the faulting context.
+     */
+    jit_populate_page(p_jit, page_6502);
+    return;
   }
 
   /* Bail unless it's a clearly recognized fault. */
@@ -785,14 +909,7 @@ jit_handle_fault(uintptr_t* p_host_rip,
     fault_reraise(p_fault_rip, p_fault_addr);
   }
 
-  p_jit = (struct jit_struct*) host_rdi;
-  /* Sanity check it is really a jit struct. */
-  if (p_jit->p_compile_callback != jit_compile) {
-    fault_reraise(p_fault_rip, p_fault_addr);
-  }
-  if (p_jit->p_jit_trampolines != (void*) K_BBC_JIT_TRAMPOLINES_ADDR) {
-    fault_reraise(p_fault_rip, p_fault_addr);
-  }
+  p_jit = jit_get_jit_from_fault(p_fault_rip, p_fault_addr, host_rdi);
 
   if ((p_jit->counter_num_faults % 10000) == 0) {
     /* We shouldn't call logging in the fault context (re-entrancy etc.) so set
@@ -819,7 +936,6 @@ static void
 jit_init(struct cpu_driver* p_cpu_driver) {
   struct interp_struct* p_interp;
   struct inturbo_struct* p_inturbo;
-  size_t i;
   size_t mapping_size;
   uint8_t* p_jit_base;
   uint8_t* p_jit_trampolines;
@@ -851,8 +967,14 @@ jit_init(struct cpu_driver* p_cpu_driver) {
   p_funcs->set_exit_value = jit_set_exit_value;
   p_funcs->memory_range_invalidate = jit_memory_range_invalidate;
   p_funcs->get_address_info = jit_get_address_info;
+  p_funcs->request_code_dump = jit_request_code_dump;
   p_funcs->get_custom_counters = jit_get_custom_counters;
 
+  assert(offsetof(struct jit_struct, p_host_sp_base) ==
+         K_JIT_CONTEXT_OFFSET_HOST_SP_BASE);
+  assert(offsetof(struct jit_struct, p_host_sp_floor) ==
+         K_JIT_CONTEXT_OFFSET_HOST_SP_FLOOR);
+
   p_cpu_driver->abi.p_util_private = asm_jit_compile_trampoline;
   p_jit->p_compile_callback = jit_compile;
 
@@ -900,9 +1022,10 @@ jit_init(struct cpu_driver* p_cpu_driver) {
   p_jit->p_mapping_jit = os_alloc_get_mapping((void*) K_BBC_JIT_ADDR,
                                               mapping_size);
   p_jit_base = os_alloc_get_mapping_addr(p_jit->p_mapping_jit);
-  os_alloc_make_mapping_read_write_exec(p_jit_base, mapping_size);
-  /* Fill with int3. */
-  (void) memset(p_jit_base, '\xcc', mapping_size);
+  /* The code space is populated one 6502 page at a time, on first use. This
+   * keeps startup fast, particularly for short headless runs.
+   */
+  os_alloc_make_mapping_none(p_jit_base, mapping_size);
 
   /* This is the mapping that holds trampolines to jump out of JIT. These
    * one-per-6502-address trampolines enable the core JIT code to be simpler
@@ -913,12 +1036,18 @@ jit_init(struct cpu_driver* p_cpu_driver) {
   p_jit->p_mapping_trampolines =
       os_alloc_get_mapping((void*) K_BBC_JIT_TRAMPOLINES_ADDR, mapping_size);
   p_jit_trampolines = os_alloc_get_mapping_addr(p_jit->p_mapping_trampolines);
-  os_alloc_make_mapping_read_write_exec(p_jit_trampolines, mapping_size);
-  /* Fill with int3. */
-  (void) memset(p_jit_trampolines, '\xcc', mapping_size);
+  /* Populated alongside the code space. */
+  os_alloc_make_mapping_none(p_jit_trampolines, mapping_size);
 
   p_jit->p_jit_base = p_jit_base;
   p_jit->p_jit_trampolines = p_jit_trampolines;
+
+  /* Needed to populate pages, which the compiler creation will do. */
+  p_temp_buf = util_buffer_create();
+  p_jit->p_temp_buf = p_temp_buf;
+  util_buffer_setup(p_temp_buf, &p_jit->jit_invalidation_sequence[0], 2);
+  asm_emit_jit_call_compile_trampoline(p_temp_buf);
+
   p_jit->p_compiler = jit_compiler_create(
       p_timing,
       p_memory_access,
@@ -933,8 +1062,6 @@ jit_init(struct cpu_driver* p_cpu_driver) {
       p_jit->p_opcode_modes,
       p_jit->p_opcode_mem,
       p_jit->p_opcode_cycles);
-  p_temp_buf = util_buffer_create();
-  p_jit->p_temp_buf = p_temp_buf;
   p_jit->jit_ptr_no_code =
       (uint32_t) (size_t) jit_get_jit_block_host_address(
           p_jit, (k_6502_addr_space_size - 1));
@@ -942,27 +1069,15 @@ jit_init(struct cpu_driver* p_cpu_driver) {
       (uint32_t) (size_t) jit_get_jit_block_host_address(
           p_jit, (k_6502_addr_space_size - 2));
 
-  util_buffer_setup(p_temp_buf, &p_jit->jit_invalidation_sequence[0], 2);
-  asm_emit_jit_call_compile_trampoline(p_temp_buf);
-
-  for (i = 0; i < k_6502_addr_space_size; ++i) {
-    /* Initialize JIT trampoline. */
-    util_buffer_setup(
-        p_temp_buf,
-        (p_jit_trampolines + (i * K_BBC_JIT_TRAMPOLINE_BYTES)),
-        K_BBC_JIT_TRAMPOLINE_BYTES);
-    asm_emit_jit_jump_interp_trampoline(p_temp_buf, i);
-  }
-
   /* Ah the horrors, a fault / SIGSEGV handler! This actually enables a ton of
    * optimizations by using faults for very uncommon conditions, such that the
    * fast path doesn't need certain checks.
    */
   os_fault_register_handler(jit_handle_fault);
 
-  /* NOTE: the JIT code space hasn't been set up with the invalidation markers.
-   * Power-on reset has the responsibility of marking the entire address space
-   * as invalidated.
+  /* NOTE: the JIT code space is set up with the invalidation markers as each
+   * page is populated. Power-on reset still has the responsibility of
+   * invalidating the entire address space, to reset the metadata.
    */
 }
 
@@ -16,18 +16,54 @@
 #include "asm/asm_jit_defs.h"
 
 #include <assert.h>
+#include <stdio.h>
 #include <string.h>
 
 enum {
   k_opcode_history_length = 8,
 };
 
+/* Full compile history is only kept for addresses compiled more than once,
+ * i.e. self-modified code or block splits. These are allocated from a pool
+ * that is indexed from the per-address metadata.
+ */
 struct jit_compile_history {
   uint64_t times[k_opcode_history_length];
   int32_t opcodes[k_opcode_history_length];
   uint8_t was_self_modified[k_opcode_history_length];
   uint32_t ring_buffer_index;
-  int32_t opcode;
+  int32_t next_free;
+};
+
+enum {
+  k_addr_flag_block_start = 1,
+  k_addr_flag_block_continuation = 2,
+  k_addr_flag_was_self_modified = 4,
+  k_addr_flag_a_fixup = 8,
+  k_addr_flag_x_fixup = 16,
+  k_addr_flag_y_fixup = 32,
+  k_addr_flag_nz_mem_fixup = 64,
+  k_addr_flag_irq_check = 128,
+};
+
+/* Per-address metadata, packed together so that compiling or fixing up an
+ * address touches a single cache line.
+ */
+struct jit_compile_addr {
+  /* Time of the last compile, for addresses without a history entry. */
+  uint64_t compile_ticks;
+  int32_t cycles_fixup;
+  int32_t history_index;
+  int16_t opcode;
+  uint16_t nz_mem_fixup;
+  uint8_t nz_fixup;
+  uint8_t o_fixup;
+  uint8_t c_fixup;
+  uint8_t a_fixup;
+  uint8_t x_fixup;
+  uint8_t y_fixup;
+  uint8_t s_fixup;
+  uint8_t flags;
 };
 
 struct jit_compiler {
@@ -41,6 +77,9 @@ struct jit_compiler {
   int32_t* p_code_blocks;
   int debug;
   int log_dynamic;
+  int log_dump;
+  char* p_dump_dir;
+  int32_t dump_addr;
   uint8_t* p_opcode_types;
   uint8_t* p_opcode_modes;
   uint8_t* p_opcode_mem;
@@ -56,6 +95,7 @@ struct jit_compiler {
 
   struct util_buffer* p_tmp_buf;
   struct util_buffer* p_single_uopcode_buf;
+  struct util_buffer* p_jsr_pad_buf;
   uint32_t jit_ptr_no_code;
   uint32_t jit_ptr_dynamic_operand;
 
@@ -63,18 +103,21 @@ struct jit_compiler {
 
   int compile_for_code_in_zero_page;
 
-  struct jit_compile_history history[k_6502_addr_space_size];
-  uint8_t addr_is_block_start[k_6502_addr_space_size];
-  uint8_t addr_is_block_continuation[k_6502_addr_space_size];
-
-  int32_t addr_cycles_fixup[k_6502_addr_space_size];
-  uint8_t addr_nz_fixup[k_6502_addr_space_size];
-  int32_t addr_nz_mem_fixup[k_6502_addr_space_size];
-  uint8_t addr_o_fixup[k_6502_addr_space_size];
-  uint8_t addr_c_fixup[k_6502_addr_space_size];
-  int32_t addr_a_fixup[k_6502_addr_space_size];
-  int32_t addr_x_fixup[k_6502_addr_space_size];
-  int32_t addr_y_fixup[k_6502_addr_space_size];
+  /* Stores to pages that have never had code compiled in them skip the
+   * self-modify invalidation. Such pages are marked as having unchecked
+   * writes, and if code is later compiled in one, all code needs
+   * invalidating.
+   */
+  uint8_t is_code_page[k_6502_addr_space_size / 256];
+  uint8_t is_unchecked_write_page[k_6502_addr_space_size / 256];
+  int has_unchecked_code_writes;
+
+  struct jit_compile_history* p_histories;
+  uint32_t num_histories_alloc;
+  uint32_t num_histories_used;
+  int32_t history_free_list;
+
+  struct jit_compile_addr addrs[k_6502_addr_space_size];
 };
 
 enum {
@@ -90,10 +133,18 @@ jit_invalidate_jump_target(struct jit_compiler* p_compiler, uint16_t addr) {
   asm_emit_jit_call_compile_trampoline(p_compiler->p_tmp_buf);
 }
 
+static void
+jit_compiler_init_addr(struct jit_compile_addr* p_addr) {
+  (void) memset(p_addr, '\0', sizeof(struct jit_compile_addr));
+  p_addr->cycles_fixup = -1;
+  p_addr->history_index = -1;
+  p_addr->opcode = -1;
+}
+
 static int32_t
 jit_compiler_get_current_opcode(struct jit_compiler* p_compiler,
                                 uint16_t addr_6502) {
-  return p_compiler->history[addr_6502].opcode;
+  return p_compiler->addrs[addr_6502].opcode;
 }
 
 static int
@@ -183,6 +234,11 @@ jit_compiler_create(struct timing_struct* p_timing,
       util_has_option(p_options->p_opt_flags, "jit:no-sub-instruction");
   p_compiler->log_dynamic = util_has_option(p_options->p_log_flags,
                                             "jit:dynamic");
+  p_compiler->log_dump = util_has_option(p_options->p_log_flags, "jit:dump");
+  (void) util_get_str_option(&p_compiler->p_dump_dir,
+                             p_options->p_opt_flags,
+                             "jit:dump-dir=");
+  p_compiler->dump_addr = -1;
 
   (void) util_get_u32_option(&max_6502_opcodes_per_block,
                              p_options->p_opt_flags,
@@ -204,6 +260,7 @@ jit_compiler_create(struct timing_struct* p_timing,
   p_tmp_buf = util_buffer_create();
   p_compiler->p_tmp_buf = p_tmp_buf;
   p_compiler->p_single_uopcode_buf = util_buffer_create();
+  p_compiler->p_jsr_pad_buf = util_buffer_create();
 
   p_compiler->jit_ptr_no_code =
       (uint32_t) (size_t) get_block_host_address(p_host_address_object,
@@ -215,8 +272,16 @@ jit_compiler_create(struct timing_struct* p_timing,
   for (i = 0; i < k_6502_addr_space_size; ++i) {
     p_compiler->p_jit_ptrs[i] = p_compiler->jit_ptr_no_code;
     p_compiler->p_code_blocks[i] = -1;
+    jit_compiler_init_addr(&p_compiler->addrs[i]);
   }
 
+  p_compiler->num_histories_alloc = 256;
+  p_compiler->p_histories =
+      util_malloc(p_compiler->num_histories_alloc *
+                  sizeof(struct jit_compile_history));
+  p_compiler->num_histories_used = 0;
+  p_compiler->history_free_list = -1;
+
   /* Calculate lengths of sequences we need to know. */
   util_buffer_setup(p_tmp_buf, &buf[0], sizeof(buf));
   /* Note: target pointer is a short jump range. */
@@ -230,9 +295,21 @@ void
 jit_compiler_destroy(struct jit_compiler* p_compiler) {
   util_buffer_destroy(p_compiler->p_tmp_buf);
   util_buffer_destroy(p_compiler->p_single_uopcode_buf);
+  util_buffer_destroy(p_compiler->p_jsr_pad_buf);
+  if (p_compiler->p_dump_dir != NULL) {
+    util_free(p_compiler->p_dump_dir);
+  }
+  util_free(p_compiler->p_histories);
   util_free(p_compiler);
 }
 
+static uint16_t
+jit_compiler_read_vector(uint8_t* p_mem_read, uint16_t addr) {
+  /* On the 6502, (e.g.) JMP (&10FF) does not fetch across the page boundary. */
+  uint16_t next_addr = ((addr & 0xFF00) | ((addr + 1) & 0xFF));
+  return ((p_mem_read[next_addr] << 8) | p_mem_read[addr]);
+}
+
 static void
 jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
                                 struct jit_opcode_details* p_details,
@@ -253,6 +330,7 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
   struct jit_uop* p_first_post_debug_uop = p_uop;
   int use_interp = 0;
   int could_page_cross = 1;
+  int is_snapshot_read = 0;
   uint16_t rel_target_6502 = 0;
 
   (void) memset(p_details, '\0', sizeof(struct jit_opcode_details));
@@ -340,13 +418,28 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
     }
 
     if (opmem & k_opmem_read_flag) {
-      if (p_memory_access->memory_read_needs_callback(
-              p_memory_callback, p_details->min_6502_addr)) {
-        use_interp = 1;
-      }
-      if (p_memory_access->memory_read_needs_callback(
-              p_memory_callback, p_details->max_6502_addr)) {
-        use_interp = 1;
+      /* In fast mode, a plain read of a side effect free hardware register
+       * can hit the snapshot kept under the hardware registers, instead of
+       * bouncing to the interpreter. The stretched 1MHz cycle is
+       * approximated.
+       */
+      if ((opmode == k_abs) &&
+          !(opmem & k_opmem_write_flag) &&
+          !p_compiler->option_accurate_timings &&
+          p_memory_access->memory_read_needs_callback(p_memory_callback,
+                                                      operand_6502) &&
+          p_memory_access->memory_read_has_snapshot(p_memory_callback,
+                                                    operand_6502)) {
+        is_snapshot_read = 1;
+      } else {
+        if (p_memory_access->memory_read_needs_callback(
+                p_memory_callback, p_details->min_6502_addr)) {
+          use_interp = 1;
+        }
+        if (p_memory_access->memory_read_needs_callback(
+                p_memory_callback, p_details->max_6502_addr)) {
+          use_interp = 1;
+        }
       }
     }
     if (opmem & k_opmem_write_flag) {
@@ -392,6 +485,9 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
   p_details->operand_6502 = operand_6502;
 
   p_details->max_cycles_orig = p_compiler->p_opcode_cycles[opcode_6502];
+  if (is_snapshot_read) {
+    p_details->max_cycles_orig++;
+  }
   if (p_compiler->option_accurate_timings) {
     if ((opmem & k_opmem_read_flag) &&
         (opmode == k_abx || opmode == k_aby || opmode == k_idy) &&
@@ -526,6 +622,13 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
     break;
   case k_jmp:
     if (opmode == k_ind) {
+      /* Inline cache the current vector value, so that the common case of a
+       * stable vector (e.g. the MOS's OSWRCH vector) is a direct jump.
+       */
+      jit_opcode_make_uop1(p_uop,
+                           k_opcode_JMP_SCRATCH_PREDICTED,
+                           jit_compiler_read_vector(p_mem_read, operand_6502));
+      p_uop++;
       jit_opcode_make_uop1(p_uop, k_opcode_JMP_SCRATCH, 0);
       p_uop++;
     } else {
@@ -533,13 +636,17 @@ jit_compiler_get_opcode_details(struct jit_compiler* p_compiler,
     }
     break;
   case k_jsr:
-    /* JMP abs */
-    jit_opcode_make_uop1(p_uop, 0x4C, operand_6502);
-    p_uop->uoptype = k_jmp;
+    jit_opcode_make_uop1(p_uop, k_opcode_JSR_CALL, operand_6502);
+    p_uop->value2 = addr_6502;
     p_uop++;
     break;
   case k_rti:
+    jit_opcode_make_uop1(p_uop, k_opcode_JMP_SCRATCH, 0);
+    p_uop++;
+    break;
   case k_rts:
+    jit_opcode_make_uop1(p_uop, k_opcode_RTS_PREDICTED, 0);
+    p_uop++;
     jit_opcode_make_uop1(p_uop, k_opcode_JMP_SCRATCH, 0);
     p_uop++;
     break;
@@ -750,6 +857,7 @@ jit_compiler_emit_uop(struct jit_compiler* p_compiler,
   uint32_t segment_abn_write;
   int is_always_ram;
   int is_always_ram_abn;
+  void* p_jsr_pad;
 
   is_always_ram = p_memory_access->memory_is_always_ram(p_memory_object,
                                                         (uint16_t) value1);
@@ -887,6 +995,33 @@ jit_compiler_emit_uop(struct jit_compiler* p_compiler,
   case k_opcode_JMP_SCRATCH:
     asm_emit_jit_JMP_SCRATCH(p_dest_buf);
     break;
+  case k_opcode_JMP_SCRATCH_PREDICTED:
+    asm_emit_jit_JMP_SCRATCH_PREDICTED(
+        p_dest_buf,
+        (uint16_t) value1,
+        p_compiler->get_block_host_address(p_host_address_object,
+                                           (uint16_t) value1));
+    break;
+  case k_opcode_JSR_CALL:
+    /* The JSR's host call frame is set up by a pad in the JSR address'
+     * trampoline slot, so that the frame's host return address is fixed.
+     */
+    p_jsr_pad = (p_compiler->get_trampoline_host_address(
+                     p_host_address_object, (uint16_t) value2) +
+                 K_BBC_JIT_TRAMPOLINE_PAD_OFFSET);
+    util_buffer_setup(p_compiler->p_jsr_pad_buf,
+                      p_jsr_pad,
+                      (K_BBC_JIT_TRAMPOLINE_BYTES -
+                       K_BBC_JIT_TRAMPOLINE_PAD_OFFSET));
+    asm_emit_jit_jsr_pad(
+        p_compiler->p_jsr_pad_buf,
+        (uint16_t) (value2 + 3),
+        p_compiler->get_block_host_address(p_host_address_object,
+                                           (uint16_t) value1),
+        p_compiler->get_block_host_address(p_host_address_object,
+                                           (uint16_t) (value2 + 3)));
+    asm_emit_jit_JSR_CALL(p_dest_buf, p_jsr_pad);
+    break;
   case k_opcode_LDA_SCRATCH_n:
     asm_emit_jit_LDA_SCRATCH(p_dest_buf, (uint8_t) value1);
     break;
@@ -947,6 +1082,18 @@ jit_compiler_emit_uop(struct jit_compiler* p_compiler,
   case k_opcode_MODE_ZPY:
     asm_emit_jit_MODE_ZPY(p_dest_buf, (uint8_t) value1);
     break;
+  case k_opcode_PHA_NO_S:
+    asm_emit_jit_PHA_NO_S(p_dest_buf);
+    break;
+  case k_opcode_PHP_NO_S:
+    asm_emit_jit_PHP_NO_S(p_dest_buf);
+    break;
+  case k_opcode_PLA_NO_S:
+    asm_emit_jit_PLA_NO_S(p_dest_buf);
+    break;
+  case k_opcode_PLP_NO_S:
+    asm_emit_jit_PLP_NO_S(p_dest_buf);
+    break;
   case k_opcode_PULL_16:
     asm_emit_jit_PULL_16(p_dest_buf);
     break;
@@ -959,6 +1106,9 @@ jit_compiler_emit_uop(struct jit_compiler* p_compiler,
   case k_opcode_ROR_ACC_n:
     asm_emit_jit_ROR_ACC_n(p_dest_buf, (uint8_t) value1);
     break;
+  case k_opcode_RTS_PREDICTED:
+    asm_emit_jit_RTS_PREDICTED(p_dest_buf);
+    break;
   case k_opcode_SAVE_CARRY:
     asm_emit_jit_SAVE_CARRY(p_dest_buf);
     break;
@@ -1460,17 +1610,11 @@ jit_compiler_emit_uop(struct jit_compiler* p_compiler,
 }
 
 static void
-jit_compiler_add_history(struct jit_compiler* p_compiler,
-                         uint16_t addr_6502,
-                         int32_t opcode_6502,
-                         int is_self_modified,
-                         uint64_t ticks) {
-  uint32_t ring_buffer_index;
-  struct jit_compile_history* p_history = &p_compiler->history[addr_6502];
-
-  p_history->opcode = opcode_6502;
-
-  ring_buffer_index = p_history->ring_buffer_index;
+jit_compiler_history_push(struct jit_compile_history* p_history,
+                          int32_t opcode_6502,
+                          int is_self_modified,
+                          uint64_t ticks) {
+  uint32_t ring_buffer_index = p_history->ring_buffer_index;
 
   ring_buffer_index++;
   if (ring_buffer_index == k_opcode_history_length) {
@@ -1483,6 +1627,88 @@ jit_compiler_add_history(struct jit_compiler* p_compiler,
   p_history->was_self_modified[ring_buffer_index] = is_self_modified;
 }
 
+static void
+jit_compiler_history_init(struct jit_compile_history* p_history,
+                          struct jit_compile_addr* p_addr) {
+  uint32_t i;
+
+  for (i = 0; i < k_opcode_history_length; ++i) {
+    p_history->times[i] = 0;
+    p_history->opcodes[i] = -1;
+    p_history->was_self_modified[i] = 0;
+  }
+  p_history->ring_buffer_index = 0;
+  p_history->next_free = -1;
+
+  /* Seed with the single compile recorded in the address metadata, if any. */
+  if (p_addr->opcode != -1) {
+    jit_compiler_history_push(
+        p_history,
+        p_addr->opcode,
+        !!(p_addr->flags & k_addr_flag_was_self_modified),
+        p_addr->compile_ticks);
+  }
+}
+
+static int32_t
+jit_compiler_alloc_history(struct jit_compiler* p_compiler) {
+  int32_t index = p_compiler->history_free_list;
+
+  if (index != -1) {
+    p_compiler->history_free_list = p_compiler->p_histories[index].next_free;
+    return index;
+  }
+
+  if (p_compiler->num_histories_used == p_compiler->num_histories_alloc) {
+    uint32_t num_alloc = (p_compiler->num_histories_alloc * 2);
+    struct jit_compile_history* p_histories =
+        util_malloc(num_alloc * sizeof(struct jit_compile_history));
+    (void) memcpy(p_histories,
+                  p_compiler->p_histories,
+                  (p_compiler->num_histories_used *
+                   sizeof(struct jit_compile_history)));
+    util_free(p_compiler->p_histories);
+    p_compiler->p_histories = p_histories;
+    p_compiler->num_histories_alloc = num_alloc;
+  }
+
+  index = p_compiler->num_histories_used;
+  p_compiler->num_histories_used++;
+  return index;
+}
+
+static void
+jit_compiler_add_history(struct jit_compiler* p_compiler,
+                         uint16_t addr_6502,
+                         int32_t opcode_6502,
+                         int is_self_modified,
+                         uint64_t ticks) {
+  struct jit_compile_history* p_history;
+  struct jit_compile_addr* p_addr = &p_compiler->addrs[addr_6502];
+  int32_t history_index = p_addr->history_index;
+
+  /* A first compile is tracked in the address metadata alone. */
+  if ((history_index == -1) && (p_addr->opcode != -1)) {
+    history_index = jit_compiler_alloc_history(p_compiler);
+    p_addr->history_index = history_index;
+    jit_compiler_history_init(&p_compiler->p_histories[history_index], p_addr);
+  }
+
+  p_addr->opcode = opcode_6502;
+  p_addr->compile_ticks = ticks;
+  p_addr->flags &= ~k_addr_flag_was_self_modified;
+  if (is_self_modified) {
+    p_addr->flags |= k_addr_flag_was_self_modified;
+  }
+
+  if (history_index == -1) {
+    return;
+  }
+
+  p_history = &p_compiler->p_histories[history_index];
+  jit_compiler_history_push(p_history, opcode_6502, is_self_modified, ticks);
+}
+
 static inline void
 jit_compiler_get_dynamic_history(struct jit_compiler* p_compiler,
                                  uint32_t* p_new_opcode_count,
@@ -1493,9 +1719,11 @@ jit_compiler_get_dynamic_history(struct jit_compiler* p_compiler,
                                  uint16_t addr_6502,
                                  int is_self_modify_invalidated) {
   uint32_t i;
+  uint32_t index;
+  struct jit_compile_history single_history;
+  struct jit_compile_history* p_history;
   uint64_t ticks = timing_get_total_timer_ticks(p_compiler->p_timing);
-  struct jit_compile_history* p_history = &p_compiler->history[addr_6502];
-  uint32_t index = p_history->ring_buffer_index;
+  struct jit_compile_addr* p_addr = &p_compiler->addrs[addr_6502];
   int had_opcode_mismatch = 0;
 
   uint32_t new_opcode_count = 0;
@@ -1503,6 +1731,14 @@ jit_compiler_get_dynamic_history(struct jit_compiler* p_compiler,
   uint32_t any_opcode_count = 0;
   uint32_t any_opcode_invalidate_count = 0;
 
+  if (p_addr->history_index != -1) {
+    p_history = &p_compiler->p_histories[p_addr->history_index];
+  } else {
+    p_history = &single_history;
+    jit_compiler_history_init(p_history, p_addr);
+  }
+  index = p_history->ring_buffer_index;
+
   for (i = 0; i < k_opcode_history_length; ++i) {
     int was_self_modified;
     int32_t old_opcode = p_history->opcodes[index];
@@ -1733,6 +1969,361 @@ jit_compiler_try_make_dynamic_opcode(struct jit_opcode_details* p_opcode) {
   }
 }
 
+static int
+jit_compiler_try_uncheck_writes(struct jit_compiler* p_compiler,
+                                uint16_t addr_start,
+                                uint16_t addr_end) {
+  uint8_t page_start = (addr_start >> 8);
+  uint8_t page_end = (addr_end >> 8);
+
+  if (p_compiler->is_code_page[page_start] ||
+      p_compiler->is_code_page[page_end]) {
+    return 0;
+  }
+  p_compiler->is_unchecked_write_page[page_start] = 1;
+  p_compiler->is_unchecked_write_page[page_end] = 1;
+
+  return 1;
+}
+
+static void
+jit_compiler_remove_write_invalidations(
+    struct jit_compiler* p_compiler,
+    struct jit_opcode_details* p_opcode_details,
+    uint32_t num_opcodes,
+    uint16_t start_addr_6502,
+    uint16_t post_block_addr_6502) {
+  uint32_t i;
+
+  uint8_t page = (start_addr_6502 >> 8);
+  uint8_t last_page = ((uint16_t) (post_block_addr_6502 - 1) >> 8);
+
+  /* Mark the pages of this block first so that any self-modification within
+   * the block keeps its invalidation.
+   */
+  while (1) {
+    if (p_compiler->is_unchecked_write_page[page]) {
+      p_compiler->has_unchecked_code_writes = 1;
+    }
+    p_compiler->is_code_page[page] = 1;
+    if (page == last_page) {
+      break;
+    }
+    page++;
+  }
+
+  for (i = 0; i < num_opcodes; ++i) {
+    struct jit_uop* p_uop;
+    struct jit_uop* p_mode_uop;
+    int32_t mode_uopcode;
+    uint16_t operand;
+    uint8_t opmode;
+
+    struct jit_opcode_details* p_details = &p_opcode_details[i];
+
+    if (p_details->len_bytes_6502_orig == 0) {
+      continue;
+    }
+    p_uop = jit_opcode_find_uop(p_details, k_opcode_WRITE_INV_ABS);
+    if (p_uop != NULL) {
+      operand = (uint16_t) p_uop->value1;
+      if (jit_compiler_try_uncheck_writes(p_compiler, operand, operand)) {
+        jit_opcode_erase_uop(p_details, k_opcode_WRITE_INV_ABS);
+      }
+      continue;
+    }
+    opmode = p_compiler->p_opcode_modes[p_details->opcode_6502];
+    if (opmode == k_abx) {
+      p_mode_uop = jit_opcode_find_uop(p_details, k_opcode_MODE_ABX);
+    } else if (opmode == k_aby) {
+      p_mode_uop = jit_opcode_find_uop(p_details, k_opcode_MODE_ABY);
+    } else {
+      continue;
+    }
+    p_uop = jit_opcode_find_uop(p_details, k_opcode_WRITE_INV_SCRATCH);
+    if ((p_mode_uop == NULL) || (p_uop == NULL)) {
+      continue;
+    }
+    mode_uopcode = p_mode_uop->uopcode;
+    operand = (uint16_t) p_mode_uop->value1;
+    if (jit_compiler_try_uncheck_writes(p_compiler,
+                                        operand,
+                                        (uint16_t) (operand + 0xFF))) {
+      /* The mode uop only calculates the address for the invalidation. */
+      jit_opcode_erase_uop(p_details, k_opcode_WRITE_INV_SCRATCH);
+      jit_opcode_erase_uop(p_details, mode_uopcode);
+    }
+  }
+}
+
+static void
+jit_compiler_hoist_irq_checks(struct jit_compiler* p_compiler,
+                              struct jit_opcode_details* p_opcode_details,
+                              uint32_t num_opcodes) {
+  uint32_t i;
+
+  struct jit_opcode_details* p_countdown_details = NULL;
+  int is_check_hoisted = 0;
+
+  /* The pending IRQ state can only change at a countdown check, or at
+   * something that bounces out to the interpreter and therefore ends the
+   * block. So all the CLI / PLP / RTI checks within a run of code covered by
+   * one countdown check can be replaced by a single check right after the
+   * countdown check. That check exits to the interpreter at the start of the
+   * run, same as an expired countdown.
+   * The addresses which had their check hoisted are recorded for debugging.
+   */
+  for (i = 0; i < num_opcodes; ++i) {
+    struct jit_opcode_details* p_details = &p_opcode_details[i];
+    struct jit_compile_addr* p_addr;
+    struct jit_uop* p_uop;
+
+    if (p_details->cycles_run_start != -1) {
+      p_countdown_details = p_details;
+      is_check_hoisted = 0;
+      continue;
+    }
+    if (p_details->len_bytes_6502_orig == 0) {
+      continue;
+    }
+    p_addr = &p_compiler->addrs[p_details->addr_6502];
+    p_addr->flags &= ~k_addr_flag_irq_check;
+    p_uop = jit_opcode_find_uop(p_details, k_opcode_CHECK_PENDING_IRQ);
+    if (p_uop == NULL) {
+      continue;
+    }
+    p_addr->flags |= k_addr_flag_irq_check;
+    jit_opcode_erase_uop(p_details, k_opcode_CHECK_PENDING_IRQ);
+    if (is_check_hoisted) {
+      continue;
+    }
+    assert(p_countdown_details != NULL);
+    assert(p_countdown_details->num_uops == 1);
+    jit_opcode_make_uop1(&p_countdown_details->uops[1],
+                         k_opcode_CHECK_PENDING_IRQ,
+                         p_countdown_details->addr_6502);
+    p_countdown_details->num_uops = 2;
+    is_check_hoisted = 1;
+  }
+}
+
+static void
+jit_compiler_format_6502(struct jit_compiler* p_compiler,
+                         char* p_buf,
+                         size_t buf_len,
+                         struct jit_opcode_details* p_details) {
+  uint8_t opcode_6502 = p_details->opcode_6502;
+  uint16_t operand_6502 = p_details->operand_6502;
+  uint8_t optype = p_compiler->p_opcode_types[opcode_6502];
+  uint8_t opmode = p_compiler->p_opcode_modes[opcode_6502];
+  const char* p_opname = g_p_opnames[optype];
+
+  if (p_details->len_bytes_6502_orig == 0) {
+    (void) snprintf(p_buf, buf_len, "(internal)");
+    return;
+  }
+  switch (opmode) {
+  case k_acc:
+    (void) snprintf(p_buf, buf_len, "%s A", p_opname);
+    break;
+  case k_imm:
+    (void) snprintf(p_buf, buf_len, "%s #$%.2X", p_opname, operand_6502);
+    break;
+  case k_zpg:
+    (void) snprintf(p_buf, buf_len, "%s $%.2X", p_opname, operand_6502);
+    break;
+  case k_abs:
+    (void) snprintf(p_buf, buf_len, "%s $%.4X", p_opname, operand_6502);
+    break;
+  case k_rel:
+    (void) snprintf(p_buf,
+                    buf_len,
+                    "%s $%.4X",
+                    p_opname,
+                    (uint16_t) (p_details->addr_6502 + 2 +
+                                (int8_t) operand_6502));
+    break;
+  case k_zpx:
+    (void) snprintf(p_buf, buf_len, "%s $%.2X,X", p_opname, operand_6502);
+    break;
+  case k_zpy:
+    (void) snprintf(p_buf, buf_len, "%s $%.2X,Y", p_opname, operand_6502);
+    break;
+  case k_abx:
+    (void) snprintf(p_buf, buf_len, "%s $%.4X,X", p_opname, operand_6502);
+    break;
+  case k_aby:
+    (void) snprintf(p_buf, buf_len, "%s $%.4X,Y", p_opname, operand_6502);
+    break;
+  case k_idx:
+    (void) snprintf(p_buf, buf_len, "%s ($%.2X,X)", p_opname, operand_6502);
+    break;
+  case k_idy:
+    (void) snprintf(p_buf, buf_len, "%s ($%.2X),Y", p_opname, operand_6502);
+    break;
+  case k_ind:
+    (void) snprintf(p_buf, buf_len, "%s ($%.4X)", p_opname, operand_6502);
+    break;
+  case k_iax:
+    (void) snprintf(p_buf, buf_len, "%s ($%.4X,X)", p_opname, operand_6502);
+    break;
+  case k_id:
+    (void) snprintf(p_buf, buf_len, "%s ($%.2X)", p_opname, operand_6502);
+    break;
+  default:
+    (void) snprintf(p_buf, buf_len, "%s", p_opname);
+    break;
+  }
+}
+
+static void
+jit_compiler_dump_opcodes(struct jit_compiler* p_compiler,
+                          struct jit_opcode_details* p_opcode_details,
+                          uint32_t num_opcodes,
+                          int is_emitted) {
+  uint32_t i_opcodes;
+  uint32_t i_uops;
+
+  for (i_opcodes = 0; i_opcodes < num_opcodes; ++i_opcodes) {
+    char buf[256];
+    size_t len;
+    struct jit_opcode_details* p_details = &p_opcode_details[i_opcodes];
+
+    if (p_details->eliminated) {
+      continue;
+    }
+
+    jit_compiler_format_6502(p_compiler, buf, sizeof(buf), p_details);
+    if (is_emitted && (p_details->len_bytes_host > 0)) {
+      uint32_t i;
+      uint8_t* p_host = (uint8_t*) p_details->p_host_address;
+      len = strlen(buf);
+      (void) snprintf((buf + len), (sizeof(buf) - len), "  [@%p]", p_host);
+      for (i = 0; i < p_details->len_bytes_host; ++i) {
+        len = strlen(buf);
+        if ((sizeof(buf) - len) < 5) {
+          break;
+        }
+        (void) snprintf((buf + len), (sizeof(buf) - len), " %.2X", p_host[i]);
+      }
+    }
+    log_do_log(k_log_jit,
+               k_log_info,
+               "  $%.4X: %s",
+               p_details->addr_6502,
+               buf);
+
+    for (i_uops = 0; i_uops < p_details->num_uops; ++i_uops) {
+      struct jit_uop* p_uop = &p_details->uops[i_uops];
+      int32_t uopcode = p_uop->uopcode;
+      if (p_uop->eliminated) {
+        continue;
+      }
+      if (uopcode <= 0xFF) {
+        (void) snprintf(buf,
+                        sizeof(buf),
+                        "%s ($%.2X)",
+                        g_p_opnames[p_compiler->p_opcode_types[uopcode]],
+                        uopcode);
+      } else {
+        (void) snprintf(buf,
+                        sizeof(buf),
+                        "%s",
+                        jit_opcode_get_uopcode_name(uopcode));
+      }
+      log_do_log(k_log_jit,
+                 k_log_info,
+                 "      %s %X %X",
+                 buf,
+                 p_uop->value1,
+                 p_uop->value2);
+    }
+  }
+}
+
+static void
+jit_compiler_dump_block(struct jit_compiler* p_compiler,
+                        struct jit_opcode_details* p_opcode_details,
+                        uint32_t num_opcodes,
+                        uint32_t num_uops_pre,
+                        uint16_t start_addr_6502,
+                        uint16_t end_addr_6502) {
+  uint32_t i_opcodes;
+  uint32_t i_uops;
+
+  uint32_t num_opcodes_6502 = 0;
+  uint32_t num_uops_post = 0;
+  uint32_t len_bytes_host = 0;
+  uint32_t max_cycles = 0;
+  uint8_t* p_host_start = NULL;
+
+  jit_compiler_dump_opcodes(p_compiler, p_opcode_details, num_opcodes, 1);
+
+  for (i_opcodes = 0; i_opcodes < num_opcodes; ++i_opcodes) {
+    struct jit_opcode_details* p_details = &p_opcode_details[i_opcodes];
+    if (p_details->len_bytes_6502_orig > 0) {
+      num_opcodes_6502++;
+      max_cycles += p_details->max_cycles_orig;
+    }
+    if (p_details->eliminated) {
+      continue;
+    }
+    for (i_uops = 0; i_uops < p_details->num_uops; ++i_uops) {
+      if (!p_details->uops[i_uops].eliminated) {
+        num_uops_post++;
+      }
+    }
+    if ((p_host_start == NULL) && (p_details->len_bytes_host > 0)) {
+      p_host_start = p_details->p_host_address;
+    }
+    len_bytes_host += p_details->len_bytes_host;
+  }
+
+  log_do_log(k_log_jit,
+             k_log_info,
+             "block $%.4X-$%.4X: %u 6502 opcodes, %u 6502 bytes, "
+             "%u -> %u uops, %u host bytes, %u max cycles",
+             start_addr_6502,
+             (uint16_t) (end_addr_6502 - 1),
+             num_opcodes_6502,
+             (uint16_t) (end_addr_6502 - start_addr_6502),
+             num_uops_pre,
+             num_uops_post,
+             len_bytes_host,
+             max_cycles);
+
+  if (p_compiler->p_dump_dir != NULL) {
+    /* Each opcode's host code is written out back to back, which matches
+     * the block's layout unless it overflowed into the next host block.
+     */
+    char file_name[256];
+    struct util_file* p_file;
+
+    (void) snprintf(file_name,
+                    sizeof(file_name),
+                    "%s/jit_%.4X.bin",
+                    p_compiler->p_dump_dir,
+                    start_addr_6502);
+    p_file = util_file_open(file_name, 1, 1);
+    for (i_opcodes = 0; i_opcodes < num_opcodes; ++i_opcodes) {
+      struct jit_opcode_details* p_details = &p_opcode_details[i_opcodes];
+      if (p_details->eliminated || (p_details->len_bytes_host == 0)) {
+        continue;
+      }
+      util_file_write(p_file,
+                      p_details->p_host_address,
+                      p_details->len_bytes_host);
+    }
+    util_file_close(p_file);
+    log_do_log(k_log_jit,
+               k_log_info,
+               "disassemble: objdump -D -b binary -mi386:x86-64 -Mintel "
+               "--adjust-vma=%p %s",
+               p_host_start,
+               file_name);
+  }
+}
+
 uint32_t
 jit_compiler_compile_block(struct jit_compiler* p_compiler,
                            int is_invalidation,
@@ -1764,11 +2355,20 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
   int is_block_start = 0;
   int is_next_block_continuation = 0;
   int32_t sub_instruction_addr_6502 = -1;
+  int is_dump = p_compiler->log_dump;
+  uint32_t num_uops_pre_optimize = 0;
 
-  if (p_compiler->addr_is_block_start[start_addr_6502]) {
+  struct jit_compile_addr* p_start_addr = &p_compiler->addrs[start_addr_6502];
+
+  if (p_compiler->dump_addr == start_addr_6502) {
+    is_dump = 1;
+    p_compiler->dump_addr = -1;
+  }
+
+  if (p_start_addr->flags & k_addr_flag_block_start) {
     /* Retain any existing block start determination. */
     is_block_start = 1;
-  } else if (!p_compiler->addr_is_block_continuation[start_addr_6502] &&
+  } else if (!(p_start_addr->flags & k_addr_flag_block_continuation) &&
              !is_invalidation) {
     /* New block starts are only created if this isn't a compilation
      * continuation, and this isn't an invalidation of existing code.
@@ -1776,9 +2376,11 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
     is_block_start = 1;
   }
 
-  p_compiler->addr_is_block_start[start_addr_6502] = is_block_start;
-  /* NOTE: p_compiler->addr_is_block_continuation[start_addr_6502] is left as
-   * it currently is.
+  if (is_block_start) {
+    p_start_addr->flags |= k_addr_flag_block_start;
+  }
+  /* NOTE: the block continuation flag for start_addr_6502 is left as it
+   * currently is.
    * The only way to clear it is compile across the continuation boundary.
    */
 
@@ -1830,7 +2432,7 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
     }
 
     /* Exit loop condition: next opcode is the start of a block boundary. */
-    if (p_compiler->addr_is_block_start[addr_6502]) {
+    if (p_compiler->addrs[addr_6502].flags & k_addr_flag_block_start) {
       break;
     }
 
@@ -1854,8 +2456,10 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
 
   assert(addr_6502 > start_addr_6502);
   post_block_addr_6502 = addr_6502;
-  p_compiler->addr_is_block_continuation[addr_6502] =
-      is_next_block_continuation;
+  p_compiler->addrs[addr_6502].flags &= ~k_addr_flag_block_continuation;
+  if (is_next_block_continuation) {
+    p_compiler->addrs[addr_6502].flags |= k_addr_flag_block_continuation;
+  }
 
   /* Second, work out if we'll be compiling any dynamic opcodes / operands. */
   for (i_opcodes = 0; i_opcodes < total_num_opcodes; ++i_opcodes) {
@@ -2020,6 +2624,35 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
     p_uop->value2 = p_details_fixup->cycles_run_start;
   }
 
+  /* Remove self-modify invalidations for stores to pages without code. */
+  jit_compiler_remove_write_invalidations(p_compiler,
+                                          &opcode_details[0],
+                                          total_num_opcodes,
+                                          start_addr_6502,
+                                          post_block_addr_6502);
+
+  /* Hoist pending IRQ checks up to the countdown checks. */
+  jit_compiler_hoist_irq_checks(p_compiler,
+                                &opcode_details[0],
+                                total_num_opcodes);
+
+  if (is_dump) {
+    for (i_opcodes = 0; i_opcodes < total_num_opcodes; ++i_opcodes) {
+      p_details = &opcode_details[i_opcodes];
+      if (!p_details->eliminated) {
+        num_uops_pre_optimize += p_details->num_uops;
+      }
+    }
+    log_do_log(k_log_jit,
+               k_log_info,
+               "dump @$%.4X, before optimization:",
+               start_addr_6502);
+    jit_compiler_dump_opcodes(p_compiler,
+                              &opcode_details[0],
+                              total_num_opcodes,
+                              0);
+  }
+
   /* Fourth, run the optimizer across the list of opcodes. */
   if (!p_compiler->option_no_optimize) {
     total_num_opcodes = jit_optimizer_optimize(&opcode_details[0],
@@ -2130,6 +2763,7 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
        */
       assert(opcode_len_asm >= 2);
     }
+    p_details->len_bytes_host = opcode_len_asm;
   }
 
   /* Fill the unused portion of the buffer with 0xcc, i.e. int3.
@@ -2172,22 +2806,25 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
       }
     }
     for (i = 0; i < num_bytes_6502; ++i) {
+      struct jit_compile_addr* p_addr = &p_compiler->addrs[addr_6502];
+
       p_compiler->p_jit_ptrs[addr_6502] = jit_ptr;
       p_compiler->p_code_blocks[addr_6502] = start_addr_6502;
 
       if (addr_6502 != start_addr_6502) {
         jit_invalidate_jump_target(p_compiler, addr_6502);
-        p_compiler->addr_is_block_start[addr_6502] = 0;
-        p_compiler->addr_is_block_continuation[addr_6502] = 0;
+        p_addr->flags &= ~(k_addr_flag_block_start |
+                           k_addr_flag_block_continuation);
       }
 
-      p_compiler->addr_nz_fixup[addr_6502] = 0;
-      p_compiler->addr_nz_mem_fixup[addr_6502] = -1;
-      p_compiler->addr_o_fixup[addr_6502] = 0;
-      p_compiler->addr_c_fixup[addr_6502] = 0;
-      p_compiler->addr_a_fixup[addr_6502] = -1;
-      p_compiler->addr_x_fixup[addr_6502] = -1;
-      p_compiler->addr_y_fixup[addr_6502] = -1;
+      p_addr->nz_fixup = 0;
+      p_addr->o_fixup = 0;
+      p_addr->c_fixup = 0;
+      p_addr->s_fixup = 0;
+      p_addr->flags &= ~(k_addr_flag_a_fixup |
+                         k_addr_flag_x_fixup |
+                         k_addr_flag_y_fixup |
+                         k_addr_flag_nz_mem_fixup);
 
       if (i == 0) {
         uint8_t opcode_6502 = p_details->opcode_6502;
@@ -2201,45 +2838,52 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
                                  p_details->self_modify_invalidated,
                                  ticks);
 
-        p_compiler->addr_cycles_fixup[addr_6502] = cycles;
+        p_addr->cycles_fixup = cycles;
         for (i_uops = 0; i_uops < p_details->num_fixup_uops; ++i_uops) {
           p_uop = p_details->fixup_uops[i_uops];
           switch (p_uop->uopcode) {
           case k_opcode_FLAGA:
-            p_compiler->addr_nz_fixup[addr_6502] = k_a;
+            p_addr->nz_fixup = k_a;
             break;
           case k_opcode_FLAGX:
-            p_compiler->addr_nz_fixup[addr_6502] = k_x;
+            p_addr->nz_fixup = k_x;
             break;
           case k_opcode_FLAGY:
-            p_compiler->addr_nz_fixup[addr_6502] = k_y;
+            p_addr->nz_fixup = k_y;
             break;
           case k_opcode_FLAG_MEM:
-            p_compiler->addr_nz_mem_fixup[addr_6502] = (uint16_t) p_uop->value1;
+            p_addr->nz_mem_fixup = (uint16_t) p_uop->value1;
+            p_addr->flags |= k_addr_flag_nz_mem_fixup;
             break;
           case 0xA9: /* LDA imm */
-            p_compiler->addr_a_fixup[addr_6502] = (uint8_t) p_uop->value1;
+            p_addr->a_fixup = (uint8_t) p_uop->value1;
+            p_addr->flags |= k_addr_flag_a_fixup;
             break;
           case 0xA2: /* LDX imm */
-            p_compiler->addr_x_fixup[addr_6502] = (uint8_t) p_uop->value1;
+            p_addr->x_fixup = (uint8_t) p_uop->value1;
+            p_addr->flags |= k_addr_flag_x_fixup;
             break;
           case 0xA0: /* LDY imm */
-            p_compiler->addr_y_fixup[addr_6502] = (uint8_t) p_uop->value1;
+            p_addr->y_fixup = (uint8_t) p_uop->value1;
+            p_addr->flags |= k_addr_flag_y_fixup;
             break;
           case k_opcode_SAVE_OVERFLOW:
-            p_compiler->addr_o_fixup[addr_6502] = 1;
+            p_addr->o_fixup = 1;
+            break;
+          case k_opcode_DEC_S:
+            p_addr->s_fixup++;
             break;
           case k_opcode_SAVE_CARRY:
-            p_compiler->addr_c_fixup[addr_6502] = 1;
+            p_addr->c_fixup = 1;
             break;
           case k_opcode_SAVE_CARRY_INV:
-            p_compiler->addr_c_fixup[addr_6502] = 2;
+            p_addr->c_fixup = 2;
             break;
           case 0x18: /* CLC */
-            p_compiler->addr_c_fixup[addr_6502] = 3;
+            p_addr->c_fixup = 3;
             break;
           case 0x38: /* SEC */
-            p_compiler->addr_c_fixup[addr_6502] = 4;
+            p_addr->c_fixup = 4;
             break;
           default:
             assert(0);
@@ -2251,7 +2895,7 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
           p_compiler->p_jit_ptrs[addr_6502] =
               p_compiler->jit_ptr_dynamic_operand;
         }
-        p_compiler->addr_cycles_fixup[addr_6502] = -1;
+        p_addr->cycles_fixup = -1;
       }
 
       addr_6502++;
@@ -2259,6 +2903,16 @@ jit_compiler_compile_block(struct jit_compiler* p_compiler,
     cycles -= p_details->max_cycles_merged;
   }
 
+  if (is_dump) {
+    log_do_log(k_log_jit, k_log_info, "after optimization and emit:");
+    jit_compiler_dump_block(p_compiler,
+                            &opcode_details[0],
+                            total_num_opcodes,
+                            num_uops_pre_optimize,
+                            start_addr_6502,
+                            addr_6502);
+  }
+
   if (sub_instruction_addr_6502 != -1) {
     p_host_address_base =
         p_compiler->get_block_host_address(p_compiler->p_host_address_object,
@@ -2277,14 +2931,12 @@ jit_compiler_fixup_state(struct jit_compiler* p_compiler,
                          int64_t countdown,
                          uint64_t host_rflags) {
   uint16_t pc_6502 = p_state_6502->reg_pc;
-  int32_t cycles_fixup = p_compiler->addr_cycles_fixup[pc_6502];
-  uint8_t nz_fixup = p_compiler->addr_nz_fixup[pc_6502];
-  int32_t nz_mem_fixup = p_compiler->addr_nz_mem_fixup[pc_6502];
-  uint8_t o_fixup = p_compiler->addr_o_fixup[pc_6502];
-  uint8_t c_fixup = p_compiler->addr_c_fixup[pc_6502];
-  int32_t a_fixup = p_compiler->addr_a_fixup[pc_6502];
-  int32_t x_fixup = p_compiler->addr_x_fixup[pc_6502];
-  int32_t y_fixup = p_compiler->addr_y_fixup[pc_6502];
+  struct jit_compile_addr* p_addr = &p_compiler->addrs[pc_6502];
+  int32_t cycles_fixup = p_addr->cycles_fixup;
+  uint8_t nz_fixup = p_addr->nz_fixup;
+  uint8_t o_fixup = p_addr->o_fixup;
+  uint8_t c_fixup = p_addr->c_fixup;
+  uint8_t flags = p_addr->flags;
 
   /* cycles_fixup can be 0 in the case the opcode is bouncing to the
    * interpreter -- an invalid opcode, for example.
@@ -2292,24 +2944,28 @@ jit_compiler_fixup_state(struct jit_compiler* p_compiler,
   assert(cycles_fixup >= 0);
   countdown += cycles_fixup;
 
-  if (a_fixup != -1) {
-    state_6502_set_a(p_state_6502, a_fixup);
+  if (flags & k_addr_flag_a_fixup) {
+    state_6502_set_a(p_state_6502, p_addr->a_fixup);
   }
-  if (x_fixup != -1) {
-    state_6502_set_x(p_state_6502, x_fixup);
+  if (flags & k_addr_flag_x_fixup) {
+    state_6502_set_x(p_state_6502, p_addr->x_fixup);
   }
-  if (y_fixup != -1) {
-    state_6502_set_y(p_state_6502, y_fixup);
+  if (flags & k_addr_flag_y_fixup) {
+    state_6502_set_y(p_state_6502, p_addr->y_fixup);
   }
-  if ((nz_fixup != 0) || (nz_mem_fixup != -1)) {
+  if (p_addr->s_fixup) {
+    state_6502_set_s(p_state_6502,
+                     (uint8_t) (p_state_6502->reg_s - p_addr->s_fixup));
+  }
+  if ((nz_fixup != 0) || (flags & k_addr_flag_nz_mem_fixup)) {
     uint8_t nz_val = 0;
     uint8_t flag_n;
     uint8_t flag_z;
     uint8_t flags_new;
     switch (nz_fixup) {
     case 0:
-      assert(nz_mem_fixup != -1);
-      nz_val = p_compiler->p_mem_read[nz_mem_fixup];
+      assert(flags & k_addr_flag_nz_mem_fixup);
+      nz_val = p_compiler->p_mem_read[p_addr->nz_mem_fixup];
       break;
     case k_a:
       nz_val = p_state_6502->reg_a;
@@ -2369,32 +3025,30 @@ jit_compiler_memory_range_invalidate(struct jit_compiler* p_compiler,
   assert(addr_end <= k_6502_addr_space_size);
 
   for (i = addr; i < addr_end; ++i) {
-    uint32_t j;
-    for (j = 0; j < k_opcode_history_length; ++j) {
-      p_compiler->history[i].times[j] = 0;
-      p_compiler->history[i].opcodes[j] = -1;
-      p_compiler->history[i].was_self_modified[j] = 0;
-    }
-    p_compiler->history[i].ring_buffer_index = 0;
-    p_compiler->history[i].opcode = -1;
-    p_compiler->addr_is_block_start[i] = 0;
-    p_compiler->addr_is_block_continuation[i] = 0;
-
-    p_compiler->addr_cycles_fixup[i] = -1;
-    p_compiler->addr_nz_fixup[i] = 0;
-    p_compiler->addr_nz_mem_fixup[i] = -1;
-    p_compiler->addr_o_fixup[i] = 0;
-    p_compiler->addr_c_fixup[i] = 0;
-    p_compiler->addr_a_fixup[i] = -1;
-    p_compiler->addr_x_fixup[i] = -1;
-    p_compiler->addr_y_fixup[i] = -1;
+    struct jit_compile_addr* p_addr = &p_compiler->addrs[i];
+    int32_t history_index = p_addr->history_index;
+    if (history_index != -1) {
+      p_compiler->p_histories[history_index].next_free =
+          p_compiler->history_free_list;
+      p_compiler->history_free_list = history_index;
+    }
+    jit_compiler_init_addr(p_addr);
+  }
+
+  /* If all code is gone, so are all the unchecked writes. */
+  if ((addr == 0) && (len >= (k_6502_addr_space_size - 1))) {
+    (void) memset(p_compiler->is_unchecked_write_page,
+                  '\0',
+                  sizeof(p_compiler->is_unchecked_write_page));
+    p_compiler->has_unchecked_code_writes = 0;
   }
 }
 
 int
 jit_compiler_is_block_continuation(struct jit_compiler* p_compiler,
                                    uint16_t addr_6502) {
-  return p_compiler->addr_is_block_continuation[addr_6502];
+  return !!(p_compiler->addrs[addr_6502].flags &
+            k_addr_flag_block_continuation);
 }
 
 int
@@ -2409,6 +3063,23 @@ jit_compiler_set_compiling_for_code_in_zero_page(
   p_compiler->compile_for_code_in_zero_page = value;
 }
 
+void
+jit_compiler_set_dump_addr(struct jit_compiler* p_compiler,
+                           uint16_t addr_6502) {
+  p_compiler->dump_addr = addr_6502;
+}
+
+int
+jit_compiler_has_unchecked_code_writes(struct jit_compiler* p_compiler) {
+  return p_compiler->has_unchecked_code_writes;
+}
+
+int
+jit_compiler_is_irq_check_site(struct jit_compiler* p_compiler,
+                               uint16_t addr_6502) {
+  return !!(p_compiler->addrs[addr_6502].flags & k_addr_flag_irq_check);
+}
+
 void
 jit_compiler_testing_set_optimizing(struct jit_compiler* p_compiler,
                                     int optimizing) {
@@ -48,6 +48,13 @@ int jit_compiler_is_compiling_for_code_in_zero_page(
 void jit_compiler_set_compiling_for_code_in_zero_page(
     struct jit_compiler* p_compiler, int value);
 
+void jit_compiler_set_dump_addr(struct jit_compiler* p_compiler,
+                                uint16_t addr_6502);
+
+int jit_compiler_has_unchecked_code_writes(struct jit_compiler* p_compiler);
+int jit_compiler_is_irq_check_site(struct jit_compiler* p_compiler,
+                                   uint16_t addr_6502);
+
 void jit_compiler_testing_set_optimizing(struct jit_compiler* p_compiler,
                                          int is_optimizing);
 void jit_compiler_testing_set_dynamic_operand(struct jit_compiler* p_compiler,
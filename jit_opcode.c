@@ -95,3 +95,163 @@ jit_opcode_erase_uop(struct jit_opcode_details* p_opcode, int32_t uopcode) {
                  ((p_opcode->num_uops - i - 1) * sizeof(struct jit_uop)));
   p_opcode->num_uops--;
 }
+
+const char*
+jit_opcode_get_uopcode_name(int32_t uopcode) {
+  /* Names for the internal uopcodes only. The 6502 uopcodes are named via
+   * the 6502 opcode tables.
+   */
+  switch (uopcode) {
+  case k_opcode_countdown:
+    return "countdown";
+  case k_opcode_debug:
+    return "debug";
+  case k_opcode_interp:
+    return "interp";
+  case k_opcode_inturbo:
+    return "inturbo";
+  case k_opcode_jump_raw:
+    return "jump_raw";
+  case k_opcode_for_testing:
+    return "for_testing";
+  case k_opcode_ADD_CYCLES:
+    return "ADD_CYCLES";
+  case k_opcode_ADD_ABS:
+    return "ADD_ABS";
+  case k_opcode_ADD_ABX:
+    return "ADD_ABX";
+  case k_opcode_ADD_ABY:
+    return "ADD_ABY";
+  case k_opcode_ADD_IMM:
+    return "ADD_IMM";
+  case k_opcode_ADD_SCRATCH:
+    return "ADD_SCRATCH";
+  case k_opcode_ADD_SCRATCH_Y:
+    return "ADD_SCRATCH_Y";
+  case k_opcode_ASL_ACC_n:
+    return "ASL_ACC_n";
+  case k_opcode_CHECK_BCD:
+    return "CHECK_BCD";
+  case k_opcode_CHECK_PAGE_CROSSING_SCRATCH_n:
+    return "CHECK_PAGE_CROSSING_SCRATCH_n";
+  case k_opcode_CHECK_PAGE_CROSSING_SCRATCH_X:
+    return "CHECK_PAGE_CROSSING_SCRATCH_X";
+  case k_opcode_CHECK_PAGE_CROSSING_SCRATCH_Y:
+    return "CHECK_PAGE_CROSSING_SCRATCH_Y";
+  case k_opcode_CHECK_PAGE_CROSSING_X_n:
+    return "CHECK_PAGE_CROSSING_X_n";
+  case k_opcode_CHECK_PAGE_CROSSING_Y_n:
+    return "CHECK_PAGE_CROSSING_Y_n";
+  case k_opcode_CHECK_PENDING_IRQ:
+    return "CHECK_PENDING_IRQ";
+  case k_opcode_CLEAR_CARRY:
+    return "CLEAR_CARRY";
+  case k_opcode_DEC_S:
+    return "DEC_S";
+  case k_opcode_EOR_SCRATCH_n:
+    return "EOR_SCRATCH_n";
+  case k_opcode_FLAGA:
+    return "FLAGA";
+  case k_opcode_FLAGX:
+    return "FLAGX";
+  case k_opcode_FLAGY:
+    return "FLAGY";
+  case k_opcode_FLAG_MEM:
+    return "FLAG_MEM";
+  case k_opcode_INC_SCRATCH:
+    return "INC_SCRATCH";
+  case k_opcode_INVERT_CARRY:
+    return "INVERT_CARRY";
+  case k_opcode_JMP_SCRATCH:
+    return "JMP_SCRATCH";
+  case k_opcode_JMP_SCRATCH_PREDICTED:
+    return "JMP_SCRATCH_PREDICTED";
+  case k_opcode_JSR_CALL:
+    return "JSR_CALL";
+  case k_opcode_LDA_SCRATCH_n:
+    return "LDA_SCRATCH_n";
+  case k_opcode_LDA_SCRATCH_X:
+    return "LDA_SCRATCH_X";
+  case k_opcode_LDA_Z:
+    return "LDA_Z";
+  case k_opcode_LDX_Z:
+    return "LDX_Z";
+  case k_opcode_LDY_Z:
+    return "LDY_Z";
+  case k_opcode_LOAD_CARRY_FOR_BRANCH:
+    return "LOAD_CARRY_FOR_BRANCH";
+  case k_opcode_LOAD_CARRY_FOR_CALC:
+    return "LOAD_CARRY_FOR_CALC";
+  case k_opcode_LOAD_CARRY_INV_FOR_CALC:
+    return "LOAD_CARRY_INV_FOR_CALC";
+  case k_opcode_LOAD_OVERFLOW:
+    return "LOAD_OVERFLOW";
+  case k_opcode_LOAD_SCRATCH_8:
+    return "LOAD_SCRATCH_8";
+  case k_opcode_LOAD_SCRATCH_16:
+    return "LOAD_SCRATCH_16";
+  case k_opcode_LSR_ACC_n:
+    return "LSR_ACC_n";
+  case k_opcode_MODE_ABX:
+    return "MODE_ABX";
+  case k_opcode_MODE_ABY:
+    return "MODE_ABY";
+  case k_opcode_MODE_IND_8:
+    return "MODE_IND_8";
+  case k_opcode_MODE_IND_16:
+    return "MODE_IND_16";
+  case k_opcode_MODE_IND_SCRATCH_8:
+    return "MODE_IND_SCRATCH_8";
+  case k_opcode_MODE_IND_SCRATCH_16:
+    return "MODE_IND_SCRATCH_16";
+  case k_opcode_MODE_ZPX:
+    return "MODE_ZPX";
+  case k_opcode_MODE_ZPY:
+    return "MODE_ZPY";
+  case k_opcode_PHA_NO_S:
+    return "PHA_NO_S";
+  case k_opcode_PHP_NO_S:
+    return "PHP_NO_S";
+  case k_opcode_PLA_NO_S:
+    return "PLA_NO_S";
+  case k_opcode_PLP_NO_S:
+    return "PLP_NO_S";
+  case k_opcode_PULL_16:
+    return "PULL_16";
+  case k_opcode_PUSH_16:
+    return "PUSH_16";
+  case k_opcode_ROL_ACC_n:
+    return "ROL_ACC_n";
+  case k_opcode_ROR_ACC_n:
+    return "ROR_ACC_n";
+  case k_opcode_RTS_PREDICTED:
+    return "RTS_PREDICTED";
+  case k_opcode_SAVE_CARRY:
+    return "SAVE_CARRY";
+  case k_opcode_SAVE_CARRY_INV:
+    return "SAVE_CARRY_INV";
+  case k_opcode_SAVE_OVERFLOW:
+    return "SAVE_OVERFLOW";
+  case k_opcode_SET_CARRY:
+    return "SET_CARRY";
+  case k_opcode_STA_SCRATCH_n:
+    return "STA_SCRATCH_n";
+  case k_opcode_STOA_IMM:
+    return "STOA_IMM";
+  case k_opcode_SUB_ABS:
+    return "SUB_ABS";
+  case k_opcode_SUB_IMM:
+    return "SUB_IMM";
+  case k_opcode_WRITE_INV_ABS:
+    return "WRITE_INV_ABS";
+  case k_opcode_WRITE_INV_SCRATCH:
+    return "WRITE_INV_SCRATCH";
+  case k_opcode_WRITE_INV_SCRATCH_n:
+    return "WRITE_INV_SCRATCH_n";
+  case k_opcode_WRITE_INV_SCRATCH_Y:
+    return "WRITE_INV_SCRATCH_Y";
+  default:
+    assert(0);
+    return "???";
+  }
+}
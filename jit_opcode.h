@@ -47,6 +47,7 @@ struct jit_opcode_details {
   struct jit_uop* fixup_uops[k_max_uops_per_opcode];
   uint8_t len_bytes_6502_merged;
   uint8_t max_cycles_merged;
+  uint32_t len_bytes_host;
   int eliminated;
   int self_modify_invalidated;
   int is_dynamic_opcode;
@@ -76,6 +77,7 @@ enum {
   k_opcode_CHECK_PAGE_CROSSING_Y_n,
   k_opcode_CHECK_PENDING_IRQ,
   k_opcode_CLEAR_CARRY,
+  k_opcode_DEC_S,
   k_opcode_EOR_SCRATCH_n,
   k_opcode_FLAGA,
   k_opcode_FLAGX,
@@ -84,6 +86,8 @@ enum {
   k_opcode_INC_SCRATCH,
   k_opcode_INVERT_CARRY,
   k_opcode_JMP_SCRATCH,
+  k_opcode_JMP_SCRATCH_PREDICTED,
+  k_opcode_JSR_CALL,
   k_opcode_LDA_SCRATCH_n,
   k_opcode_LDA_SCRATCH_X,
   k_opcode_LDA_Z,
@@ -104,10 +108,15 @@ enum {
   k_opcode_MODE_IND_SCRATCH_16,
   k_opcode_MODE_ZPX,
   k_opcode_MODE_ZPY,
+  k_opcode_PHA_NO_S,
+  k_opcode_PHP_NO_S,
+  k_opcode_PLA_NO_S,
+  k_opcode_PLP_NO_S,
   k_opcode_PULL_16,
   k_opcode_PUSH_16,
   k_opcode_ROL_ACC_n,
   k_opcode_ROR_ACC_n,
+  k_opcode_RTS_PREDICTED,
   k_opcode_SAVE_CARRY,
   k_opcode_SAVE_CARRY_INV,
   k_opcode_SAVE_OVERFLOW,
@@ -145,4 +154,6 @@ struct jit_uop* jit_opcode_find_uop(struct jit_opcode_details* p_opcode,
 
 void jit_opcode_erase_uop(struct jit_opcode_details* p_opcode, int32_t uopcode);
 
+const char* jit_opcode_get_uopcode_name(int32_t uopcode);
+
 #endif /* JIT_OPCODE_H */
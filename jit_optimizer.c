@@ -50,6 +50,9 @@ jit_optimizer_uopcode_can_jump(int32_t uopcode) {
   } else {
     switch (uopcode) {
     case k_opcode_JMP_SCRATCH:
+    case k_opcode_JMP_SCRATCH_PREDICTED:
+    case k_opcode_JSR_CALL:
+    case k_opcode_RTS_PREDICTED:
       ret = 1;
       break;
     default:
@@ -487,6 +490,216 @@ jit_optimizer_uop_invalidates_idy(struct jit_uop* p_uop,
   return ret;
 }
 
+static struct jit_uop*
+jit_optimizer_find_zpg_store(struct jit_opcode_details* p_opcode) {
+  /* Plain zero page stores, which may have been replaced with a store of a
+   * known value.
+   */
+  uint8_t opcode_6502 = p_opcode->opcode_6502;
+  struct jit_uop* p_uop;
+
+  if (p_opcode->is_dynamic_operand) {
+    return NULL;
+  }
+  switch (opcode_6502) {
+  case 0x84: /* STY zpg */
+  case 0x85: /* STA zpg */
+  case 0x86: /* STX zpg */
+    break;
+  default:
+    return NULL;
+  }
+  p_uop = jit_opcode_find_uop(p_opcode, opcode_6502);
+  if (p_uop == NULL) {
+    p_uop = jit_opcode_find_uop(p_opcode, k_opcode_STOA_IMM);
+  }
+  if ((p_uop == NULL) || p_uop->eliminated) {
+    return NULL;
+  }
+  return p_uop;
+}
+
+static int
+jit_optimizer_opcode_could_exit_or_read(struct jit_opcode_details* p_opcode,
+                                        uint16_t addr) {
+  /* Used to check that nothing can observe a zero page store being skipped.
+   * Zero page access can't fault and a pending IRQ is only checked at
+   * specific uops, so it's enough to enumerate what's safe.
+   */
+  uint32_t i_uops;
+  uint8_t opcode_6502 = p_opcode->opcode_6502;
+  uint8_t optype = defs_6502_get_6502_optype_map()[opcode_6502];
+  uint8_t opmode = defs_6502_get_6502_opmode_map()[opcode_6502];
+
+  if ((p_opcode->len_bytes_6502_orig == 0) ||
+      p_opcode->is_dynamic_opcode ||
+      p_opcode->is_dynamic_operand) {
+    return 1;
+  }
+  if (g_opbranch[optype] != k_bra_n) {
+    return 1;
+  }
+  switch (optype) {
+  case k_kil:
+  case k_unk:
+  case k_cli:
+  case k_plp:
+    return 1;
+  default:
+    break;
+  }
+  switch (opmode) {
+  case k_nil:
+  case k_acc:
+  case k_imm:
+    break;
+  case k_zpg:
+    if (p_opcode->operand_6502 == addr) {
+      return 1;
+    }
+    break;
+  default:
+    return 1;
+  }
+  for (i_uops = 0; i_uops < p_opcode->num_uops; ++i_uops) {
+    switch (p_opcode->uops[i_uops].uopcode) {
+    case k_opcode_countdown:
+    case k_opcode_debug:
+    case k_opcode_interp:
+    case k_opcode_inturbo:
+    case k_opcode_CHECK_PENDING_IRQ:
+    case k_opcode_WRITE_INV_ABS:
+    case k_opcode_WRITE_INV_SCRATCH:
+      return 1;
+    default:
+      break;
+    }
+  }
+  return 0;
+}
+
+static int32_t
+jit_optimizer_get_unindexed_uopcode(int32_t uopcode) {
+  /* For an indexed 6502 opcode, the same operation on a direct address. Only
+   * opcodes that are the same on the 6502 and 65c12 are listed. ROL / ROR
+   * are missing because their direct forms rely on a separate FLAG_MEM uop.
+   */
+  switch (uopcode) {
+  case 0x15: /* ORA zpx */
+  case 0x16: /* ASL zpx */
+  case 0x1D: /* ORA abx */
+  case 0x1E: /* ASL abx */
+  case 0x35: /* AND zpx */
+  case 0x3D: /* AND abx */
+  case 0x55: /* EOR zpx */
+  case 0x56: /* LSR zpx */
+  case 0x5D: /* EOR abx */
+  case 0x5E: /* LSR abx */
+  case 0x75: /* ADC zpx */
+  case 0x7D: /* ADC abx */
+  case 0x94: /* STY zpx */
+  case 0x95: /* STA zpx */
+  case 0x96: /* STX zpy */
+  case 0x9D: /* STA abx */
+  case 0xB4: /* LDY zpx */
+  case 0xB5: /* LDA zpx */
+  case 0xB6: /* LDX zpy */
+  case 0xBC: /* LDY abx */
+  case 0xBD: /* LDA abx */
+  case 0xBE: /* LDX aby */
+  case 0xD5: /* CMP zpx */
+  case 0xD6: /* DEC zpx */
+  case 0xDD: /* CMP abx */
+  case 0xDE: /* DEC abx */
+  case 0xF5: /* SBC zpx */
+  case 0xF6: /* INC zpx */
+  case 0xFD: /* SBC abx */
+  case 0xFE: /* INC abx */
+    return (uopcode - 0x10);
+  case 0x19: /* ORA aby */
+  case 0x39: /* AND aby */
+  case 0x59: /* EOR aby */
+  case 0x79: /* ADC aby */
+  case 0x99: /* STA aby */
+  case 0xB9: /* LDA aby */
+  case 0xD9: /* CMP aby */
+  case 0xF9: /* SBC aby */
+    return (uopcode - 0x0C);
+  default:
+    return -1;
+  }
+}
+
+static void
+jit_optimizer_fold_index(struct jit_opcode_details* p_opcode,
+                         struct jit_uop* p_uop,
+                         int32_t new_uopcode,
+                         uint8_t index) {
+  struct jit_uop* p_mode_uop;
+  struct jit_uop* p_write_inv_uop;
+  struct jit_uop* p_crossing_uop;
+  uint16_t addr;
+
+  uint16_t operand_6502 = p_opcode->operand_6502;
+  uint8_t opmode = defs_6502_get_6502_opmode_map()[p_uop->uopcode];
+
+  switch (opmode) {
+  case k_zpx:
+  case k_zpy:
+    addr = (uint8_t) (operand_6502 + index);
+    break;
+  case k_abx:
+  case k_aby:
+    /* Address space wraps went to the interpreter. */
+    assert((operand_6502 + index) <= 0xFFFF);
+    addr = (operand_6502 + index);
+    break;
+  default:
+    assert(0);
+    addr = 0;
+    break;
+  }
+
+  p_uop->uopcode = new_uopcode;
+  p_uop->value1 = addr;
+
+  /* Any address calculation is now only needed for write invalidation. */
+  p_write_inv_uop = jit_opcode_find_uop(p_opcode, k_opcode_WRITE_INV_SCRATCH);
+  if (p_write_inv_uop != NULL) {
+    p_write_inv_uop->uopcode = k_opcode_WRITE_INV_ABS;
+    p_write_inv_uop->value1 = addr;
+  }
+  p_mode_uop = jit_opcode_find_uop(p_opcode, k_opcode_MODE_ABX);
+  if (p_mode_uop == NULL) {
+    p_mode_uop = jit_opcode_find_uop(p_opcode, k_opcode_MODE_ABY);
+  }
+  if (p_mode_uop == NULL) {
+    p_mode_uop = jit_opcode_find_uop(p_opcode, k_opcode_MODE_ZPX);
+  }
+  if (p_mode_uop == NULL) {
+    p_mode_uop = jit_opcode_find_uop(p_opcode, k_opcode_MODE_ZPY);
+  }
+  if (p_mode_uop != NULL) {
+    p_mode_uop->eliminated = 1;
+  }
+
+  /* The page crossing cycle is known now too. */
+  p_crossing_uop = jit_opcode_find_uop(p_opcode,
+                                       k_opcode_CHECK_PAGE_CROSSING_X_n);
+  if (p_crossing_uop == NULL) {
+    p_crossing_uop = jit_opcode_find_uop(p_opcode,
+                                         k_opcode_CHECK_PAGE_CROSSING_Y_n);
+  }
+  if (p_crossing_uop != NULL) {
+    if (((operand_6502 & 0xFF) + index) > 0xFF) {
+      p_crossing_uop->eliminated = 1;
+    } else {
+      p_crossing_uop->uopcode = k_opcode_ADD_CYCLES;
+      p_crossing_uop->value1 = 1;
+    }
+  }
+}
+
 /* TODO: these lists are duplicative and awful. Improve. */
 static int
 jit_optimizer_uopcode_needs_or_trashes_overflow(int32_t uopcode) {
@@ -700,6 +913,13 @@ jit_optimizer_optimize(struct jit_opcode_details* p_opcodes,
   struct jit_opcode_details* p_carry_write_opcode;
   struct jit_uop* p_carry_write_uop;
   int carry_flipped_for_branch;
+  struct jit_opcode_details* p_push_opcode;
+  struct jit_uop* p_push_uop;
+  int32_t mem_a;
+  int32_t mem_x;
+  int32_t mem_y;
+  struct jit_opcode_details* p_store_opcode;
+  struct jit_uop* p_store_uop;
 
   struct jit_opcode_details* p_bcd_opcode = &p_opcodes[1];
 
@@ -861,6 +1081,28 @@ jit_optimizer_optimize(struct jit_opcode_details* p_opcodes,
       int32_t uopcode = p_uop->uopcode;
       int32_t new_add_uopcode = -1;
       int32_t new_sub_uopcode = -1;
+      int32_t unindexed_uopcode = -1;
+
+      /* Fold a known index register into the address, which may then allow
+       * further replacements below.
+       */
+      if (!p_opcode->is_dynamic_operand) {
+        unindexed_uopcode = jit_optimizer_get_unindexed_uopcode(uopcode);
+      }
+      if (unindexed_uopcode != -1) {
+        uint8_t opmode = defs_6502_get_6502_opmode_map()[uopcode];
+        int32_t index = reg_y;
+        if ((opmode == k_abx) || (opmode == k_zpx)) {
+          index = reg_x;
+        }
+        if (index != k_value_unknown) {
+          jit_optimizer_fold_index(p_opcode,
+                                   p_uop,
+                                   unindexed_uopcode,
+                                   (uint8_t) index);
+          uopcode = unindexed_uopcode;
+        }
+      }
 
       switch (uopcode) {
       case 0x61: /* ADC idx */
@@ -1133,7 +1375,181 @@ jit_optimizer_optimize(struct jit_opcode_details* p_opcodes,
     p_prev_opcode = p_opcode;
   }
 
-  /* Pass 4: first uopcode elimination pass, particularly FLAGn. */
+  /* Pass 4: zero page store to load forwarding, and dead store elimination.
+   * Track which zero page address, if any, each register is known to hold
+   * the value of. Zero page is always RAM, and within a block, nothing else
+   * writes it. A bail out to the interpreter always re-enters at a block
+   * start, so the tracking doesn't need to survive that.
+   */
+  mem_a = -1;
+  mem_x = -1;
+  mem_y = -1;
+  p_store_opcode = NULL;
+  p_store_uop = NULL;
+  for (i_opcodes = 0; i_opcodes < num_opcodes; ++i_opcodes) {
+    struct jit_uop* p_uop;
+    uint8_t opcode_6502;
+    uint16_t operand_6502;
+    uint8_t optype;
+    uint8_t opmode;
+    uint8_t opmem;
+    uint8_t opreg;
+
+    struct jit_opcode_details* p_opcode = &p_opcodes[i_opcodes];
+    if (p_opcode->eliminated) {
+      continue;
+    }
+
+    opcode_6502 = p_opcode->opcode_6502;
+    operand_6502 = p_opcode->operand_6502;
+    optype = defs_6502_get_6502_optype_map()[opcode_6502];
+    opmode = defs_6502_get_6502_opmode_map()[opcode_6502];
+    opmem = defs_6502_get_6502_opmem_map()[opcode_6502];
+
+    /* Dead store: a zero page store overwritten before anything could read
+     * or bail out.
+     */
+    p_uop = jit_optimizer_find_zpg_store(p_opcode);
+    if (p_store_opcode != NULL) {
+      if ((p_uop != NULL) &&
+          (operand_6502 == p_store_opcode->operand_6502) &&
+          (jit_opcode_find_uop(p_opcode, k_opcode_WRITE_INV_ABS) == NULL)) {
+        struct jit_opcode_details* p_eliminate_opcode = p_store_opcode;
+        jit_optimizer_eliminate(&p_eliminate_opcode, p_store_uop, NULL);
+        p_store_opcode = NULL;
+      } else if (jit_optimizer_opcode_could_exit_or_read(
+                     p_opcode, p_store_opcode->operand_6502)) {
+        p_store_opcode = NULL;
+      }
+    }
+    if ((p_uop != NULL) &&
+        (jit_opcode_find_uop(p_opcode, k_opcode_WRITE_INV_ABS) == NULL)) {
+      p_store_opcode = p_opcode;
+      p_store_uop = p_uop;
+    }
+
+    if (p_opcode->len_bytes_6502_orig == 0) {
+      if (jit_opcode_find_uop(p_opcode, k_opcode_debug) != NULL) {
+        mem_a = -1;
+        mem_x = -1;
+        mem_y = -1;
+      }
+      continue;
+    }
+    if (p_opcode->is_dynamic_opcode ||
+        p_opcode->is_dynamic_operand ||
+        (jit_opcode_find_uop(p_opcode, k_opcode_debug) != NULL)) {
+      mem_a = -1;
+      mem_x = -1;
+      mem_y = -1;
+      continue;
+    }
+
+    /* Loads of an address a register already holds. */
+    p_uop = jit_opcode_find_uop(p_opcode, opcode_6502);
+    switch (opcode_6502) {
+    case 0xA5: /* LDA zpg */
+      if (p_uop == NULL) {
+        mem_a = -1;
+      } else if (mem_a == operand_6502) {
+        p_uop->eliminated = 1;
+      } else if (mem_x == operand_6502) {
+        p_uop->uopcode = 0x8A; /* TXA */
+        mem_a = operand_6502;
+      } else if (mem_y == operand_6502) {
+        p_uop->uopcode = 0x98; /* TYA */
+        mem_a = operand_6502;
+      } else {
+        mem_a = operand_6502;
+      }
+      continue;
+    case 0xA6: /* LDX zpg */
+      if (p_uop == NULL) {
+        mem_x = -1;
+      } else if (mem_x == operand_6502) {
+        p_uop->eliminated = 1;
+      } else if (mem_a == operand_6502) {
+        p_uop->uopcode = 0xAA; /* TAX */
+        mem_x = operand_6502;
+      } else {
+        mem_x = operand_6502;
+      }
+      continue;
+    case 0xA4: /* LDY zpg */
+      if (p_uop == NULL) {
+        mem_y = -1;
+      } else if (mem_y == operand_6502) {
+        p_uop->eliminated = 1;
+      } else if (mem_a == operand_6502) {
+        p_uop->uopcode = 0xA8; /* TAY */
+        mem_y = operand_6502;
+      } else {
+        mem_y = operand_6502;
+      }
+      continue;
+    default:
+      break;
+    }
+
+    /* Memory writes. */
+    if (opmem & k_opmem_write_flag) {
+      if ((opmode == k_zpg) || ((opmode == k_abs) && (operand_6502 < 0x100))) {
+        if (mem_a == operand_6502) {
+          mem_a = -1;
+        }
+        if (mem_x == operand_6502) {
+          mem_x = -1;
+        }
+        if (mem_y == operand_6502) {
+          mem_y = -1;
+        }
+      } else {
+        mem_a = -1;
+        mem_x = -1;
+        mem_y = -1;
+      }
+    }
+    /* Stores from a register. */
+    if (opmode == k_zpg) {
+      switch (optype) {
+      case k_sta:
+        mem_a = operand_6502;
+        break;
+      case k_stx:
+        mem_x = operand_6502;
+        break;
+      case k_sty:
+        mem_y = operand_6502;
+        break;
+      default:
+        break;
+      }
+    }
+    /* Register writes. */
+    opreg = g_optype_sets_register[optype];
+    if (opmode == k_acc) {
+      opreg = k_a;
+    }
+    switch (opreg) {
+    case k_a:
+      mem_a = -1;
+      break;
+    case k_x:
+      mem_x = -1;
+      break;
+    case k_y:
+      mem_y = -1;
+      break;
+    default:
+      break;
+    }
+    if ((optype == k_lax) || (optype == k_las)) {
+      mem_a = -1;
+      mem_x = -1;
+    }
+  }
+
+  /* Pass 5: first uopcode elimination pass, particularly FLAGn. */
   p_nz_flags_opcode = NULL;
   p_nz_flags_uop = NULL;
   p_idy_opcode = NULL;
@@ -1232,7 +1648,7 @@ jit_optimizer_optimize(struct jit_opcode_details* p_opcodes,
     }
   }
 
-  /* Pass 5: second uopcode elimination pass, particularly those eliminations
+  /* Pass 6: second uopcode elimination pass, particularly those eliminations
    * that only occur well after FLAGn has been eliminated.
    */
   p_lda_opcode = NULL;
@@ -1419,5 +1835,84 @@ jit_optimizer_optimize(struct jit_opcode_details* p_opcodes,
     }
   }
 
+  /* Pass 7: stack-neutral push / pull pairs. A PHA or PHP followed by a PLA or
+   * PLP, with nothing in between that touches S, doesn't need to change S at
+   * all. The S decrement is eliminated and fixed up if we bail out between
+   * the push and the pull.
+   * Only pairs that aren't nested are fused, which avoids thinking about S
+   * wrapping.
+   */
+  p_push_opcode = NULL;
+  p_push_uop = NULL;
+  for (i_opcodes = 0; i_opcodes < num_opcodes; ++i_opcodes) {
+    uint32_t i_uops;
+    uint32_t num_uops;
+
+    struct jit_opcode_details* p_opcode = &p_opcodes[i_opcodes];
+    uint8_t opcode_6502 = p_opcode->opcode_6502;
+    if (p_opcode->eliminated) {
+      continue;
+    }
+
+    num_uops = p_opcode->num_uops;
+    for (i_uops = 0; i_uops < num_uops; ++i_uops) {
+      struct jit_uop* p_uop = &p_opcode->uops[i_uops];
+      int32_t uopcode = p_uop->uopcode;
+      if (p_uop->eliminated) {
+        continue;
+      }
+
+      /* Finalize fusion. */
+      if ((p_push_opcode != NULL) &&
+          (((uopcode == 0x68) && (opcode_6502 == 0x68)) ||
+           ((uopcode == 0x28) && (opcode_6502 == 0x28)))) {
+        struct jit_uop* p_dec_s_uop;
+        if (p_push_uop->uopcode == 0x48) {
+          p_push_uop->uopcode = k_opcode_PHA_NO_S;
+        } else {
+          p_push_uop->uopcode = k_opcode_PHP_NO_S;
+        }
+        if (uopcode == 0x68) {
+          p_uop->uopcode = k_opcode_PLA_NO_S;
+        } else {
+          p_uop->uopcode = k_opcode_PLP_NO_S;
+        }
+        jit_optimizer_append_uop(p_push_opcode, k_opcode_DEC_S);
+        p_dec_s_uop = &p_push_opcode->uops[p_push_opcode->num_uops - 1];
+        jit_optimizer_eliminate(&p_push_opcode, p_dec_s_uop, p_opcode);
+        continue;
+      }
+
+      /* Cancel fusion. */
+      switch (uopcode) {
+      case 0x08: /* PHP */
+      case 0x28: /* PLP */
+      case 0x48: /* PHA */
+      case 0x68: /* PLA */
+      case 0x9A: /* TXS */
+      case 0xBA: /* TSX */
+      case k_opcode_debug:
+      case k_opcode_interp:
+      case k_opcode_inturbo:
+      case k_opcode_PULL_16:
+      case k_opcode_PUSH_16:
+        p_push_opcode = NULL;
+        break;
+      default:
+        if (jit_optimizer_uopcode_can_jump(uopcode)) {
+          p_push_opcode = NULL;
+        }
+        break;
+      }
+
+      /* Keep track of pushes we may be able to fuse. */
+      if (((uopcode == 0x48) && (opcode_6502 == 0x48)) ||
+          ((uopcode == 0x08) && (opcode_6502 == 0x08))) {
+        p_push_opcode = p_opcode;
+        p_push_uop = p_uop;
+      }
+    }
+  }
+
   return num_opcodes;
 }
@@ -2,7 +2,7 @@
 
 #include "bbc_options.h"
 #include "log.h"
-#include "os_thread.h"
+#include "os_time.h"
 #include "state_6502.h"
 #include "timing.h"
 #include "util.h"
@@ -22,6 +22,8 @@ enum {
 
 enum {
   k_keyboard_queue_size = 16,
+  /* Must be a power of 2. */
+  k_keyboard_event_queue_size = 64,
 };
 
 enum {
@@ -36,20 +38,32 @@ struct keyboard_state {
   uint8_t alt_key_state[256];
 };
 
+struct keyboard_event {
+  uint64_t time_us;
+  uint8_t key;
+  uint8_t is_down;
+};
+
 struct keyboard_struct {
   struct timing_struct* p_timing;
   void (*p_virtual_updated_callback)(void* p);
   void* p_virtual_updated_callback_object;
+  void (*p_physical_updated_callback)(void* p);
+  void* p_physical_updated_callback_object;
   void (*p_set_fast_mode_callback)(void* p, int fast);
   void* p_set_fast_mode_callback_object;
 
   /* The OS thread populates the queue of physical key events and the BBC thread
-   * empties it from time to time.
+   * empties it via a cheap dedicated poll timer.
+   * It's a single producer, single consumer ring buffer, so no lock is needed:
+   * the OS thread only ever writes queue_head and the BBC thread only ever
+   * writes queue_tail.
    */
-  struct os_lock_struct* p_lock;
-  uint8_t queue_key[k_keyboard_queue_size];
-  uint8_t queue_isdown[k_keyboard_queue_size];
-  uint32_t queue_pos;
+  struct keyboard_event queue[k_keyboard_event_queue_size];
+  uint32_t queue_head;
+  uint32_t queue_tail;
+  uint32_t poll_timer_id;
+  uint64_t poll_cycles;
 
   struct util_file* p_capture_file;
   struct util_file* p_replay_file;
@@ -68,6 +82,7 @@ struct keyboard_struct {
   uint8_t keyboard_links;
 
   int log_replay;
+  int log_latency;
 };
 
 static void
@@ -661,6 +676,18 @@ keyboard_rewind_timer_fired(void* p) {
   }
 }
 
+static void
+keyboard_poll_timer_fired(void* p) {
+  struct keyboard_struct* p_keyboard = (struct keyboard_struct*) p;
+
+  (void) timing_adjust_timer_value(p_keyboard->p_timing,
+                                   NULL,
+                                   p_keyboard->poll_timer_id,
+                                   p_keyboard->poll_cycles);
+
+  keyboard_read_queue(p_keyboard);
+}
+
 struct keyboard_struct*
 keyboard_create(struct timing_struct* p_timing, struct bbc_options* p_options) {
   struct keyboard_struct* p_keyboard =
@@ -670,8 +697,9 @@ keyboard_create(struct timing_struct* p_timing, struct bbc_options* p_options) {
   p_keyboard->p_virtual_keyboard = util_mallocz(sizeof(struct keyboard_state));
 
   p_keyboard->p_timing = p_timing;
-  p_keyboard->p_lock = os_lock_create();
-  p_keyboard->queue_pos = 0;
+  p_keyboard->queue_head = 0;
+  p_keyboard->queue_tail = 0;
+  p_keyboard->poll_cycles = 0;
   p_keyboard->p_capture_file = NULL;
   p_keyboard->p_replay_file = NULL;
   p_keyboard->p_active = p_keyboard->p_physical_keyboard;
@@ -680,9 +708,13 @@ keyboard_create(struct timing_struct* p_timing, struct bbc_options* p_options) {
       timing_register_timer(p_timing, keyboard_replay_timer_tick, p_keyboard);
   p_keyboard->rewind_timer_id =
       timing_register_timer(p_timing, keyboard_rewind_timer_fired, p_keyboard);
+  p_keyboard->poll_timer_id =
+      timing_register_timer(p_timing, keyboard_poll_timer_fired, p_keyboard);
 
   p_keyboard->log_replay = util_has_option(p_options->p_log_flags,
                                            "keyboard:replay");
+  p_keyboard->log_latency = util_has_option(p_options->p_log_flags,
+                                            "keyboard:latency");
 
   return p_keyboard;
 }
@@ -701,7 +733,6 @@ keyboard_destroy(struct keyboard_struct* p_keyboard) {
   if (p_keyboard->p_replay_file_name != NULL) {
     util_free(p_keyboard->p_replay_file_name);
   }
-  os_lock_destroy(p_keyboard->p_lock);
   util_free(p_keyboard->p_physical_keyboard);
   util_free(p_keyboard->p_virtual_keyboard);
   util_free(p_keyboard);
@@ -720,6 +751,34 @@ keyboard_set_virtual_updated_callback(struct keyboard_struct* p_keyboard,
   p_keyboard->p_virtual_updated_callback_object = p_callback_object;
 }
 
+void
+keyboard_set_physical_updated_callback(struct keyboard_struct* p_keyboard,
+                                       void (*p_callback)(void*),
+                                       void* p_callback_object) {
+  p_keyboard->p_physical_updated_callback = p_callback;
+  p_keyboard->p_physical_updated_callback_object = p_callback_object;
+}
+
+void
+keyboard_set_poll_cycles(struct keyboard_struct* p_keyboard,
+                         uint64_t poll_cycles) {
+  struct timing_struct* p_timing = p_keyboard->p_timing;
+  uint32_t poll_timer_id = p_keyboard->poll_timer_id;
+
+  assert(poll_cycles > 0);
+
+  p_keyboard->poll_cycles = poll_cycles;
+
+  /* A changed poll rate takes effect from now, so that switching from a long
+   * period to a short one doesn't leave a long wait for the next poll.
+   */
+  if (timing_timer_is_running(p_timing, poll_timer_id)) {
+    (void) timing_set_timer_value(p_timing, poll_timer_id, poll_cycles);
+  } else {
+    (void) timing_start_timer_with_value(p_timing, poll_timer_id, poll_cycles);
+  }
+}
+
 void
 keyboard_set_fast_mode_callback(struct keyboard_struct* p_keyboard,
                                 void (*p_set_fast_mode_callback)(void* p,
@@ -973,18 +1032,22 @@ keyboard_put_key_in_queue(struct keyboard_struct* p_keyboard,
   /* Called from the system thread.
    * Only the system thread puts keys in the queue and that's all it does.
    */
-  os_lock_lock(p_keyboard->p_lock);
+  struct keyboard_event* p_event;
+  uint32_t head = p_keyboard->queue_head;
+  uint32_t tail = __atomic_load_n(&p_keyboard->queue_tail, __ATOMIC_ACQUIRE);
 
-  if (p_keyboard->queue_pos == k_keyboard_queue_size) {
+  if ((head - tail) == k_keyboard_event_queue_size) {
     log_do_log(k_log_keyboard, k_log_error, "keyboard queue full");
-    os_lock_unlock(p_keyboard->p_lock);
     return;
   }
-  p_keyboard->queue_key[p_keyboard->queue_pos] = key;
-  p_keyboard->queue_isdown[p_keyboard->queue_pos] = is_down;
-  p_keyboard->queue_pos++;
 
-  os_lock_unlock(p_keyboard->p_lock);
+  p_event = &p_keyboard->queue[head & (k_keyboard_event_queue_size - 1)];
+  p_event->time_us = os_time_get_us();
+  p_event->key = key;
+  p_event->is_down = is_down;
+
+  /* Publish the event only after it is fully written. */
+  __atomic_store_n(&p_keyboard->queue_head, (head + 1), __ATOMIC_RELEASE);
 }
 
 void
@@ -1045,6 +1108,11 @@ keyboard_apply_physical_keys(struct keyboard_struct* p_keyboard,
   if (p_keyboard->p_active == p_keyboard->p_physical_keyboard) {
     keyboard_virtual_updated(p_keyboard);
   }
+
+  if (p_keyboard->p_physical_updated_callback != NULL) {
+    p_keyboard->p_physical_updated_callback(
+        p_keyboard->p_physical_updated_callback_object);
+  }
 }
 
 void
@@ -1052,37 +1120,41 @@ keyboard_read_queue(struct keyboard_struct* p_keyboard) {
   /* Called from the BBC thread. */
   uint8_t keys[k_keyboard_queue_size];
   uint8_t is_downs[k_keyboard_queue_size];
-  uint32_t i;
   uint32_t num_keys;
+  uint32_t head;
 
-  volatile uint32_t* p_queue_pos = &p_keyboard->queue_pos;
+  uint32_t tail = p_keyboard->queue_tail;
 
   /* Always check the physical keyboard. Even if we're replaying a replay, we
    * want to honor special emulator keys, i.e. Alt+combo.
    */
-  if (*p_queue_pos == 0) {
-    return;
-  }
-
-  /* Checking p_keyboard->queue_pos unlocked above should be safe as we'll
-   * recheck any potential work with the lock.
-   */
-  os_lock_lock(p_keyboard->p_lock);
-
-  num_keys = p_keyboard->queue_pos;
-  assert(num_keys <= k_keyboard_queue_size);
-  for (i = 0; i < num_keys; ++i) {
-    uint8_t key = p_keyboard->queue_key[i];
-    uint8_t is_down = p_keyboard->queue_isdown[i];
-    keys[i] = key;
-    is_downs[i] = is_down;
-  }
+  head = __atomic_load_n(&p_keyboard->queue_head, __ATOMIC_ACQUIRE);
+  while (head != tail) {
+    /* Apply in batches no larger than a capture / replay frame. */
+    num_keys = 0;
+    while ((head != tail) && (num_keys < k_keyboard_queue_size)) {
+      struct keyboard_event* p_event =
+          &p_keyboard->queue[tail & (k_keyboard_event_queue_size - 1)];
+      keys[num_keys] = p_event->key;
+      is_downs[num_keys] = p_event->is_down;
+      num_keys++;
+      if (p_keyboard->log_latency) {
+        log_do_log(k_log_keyboard,
+                   k_log_info,
+                   "physical key %"PRIu8" latency %"PRIu64"us",
+                   p_event->key,
+                   (os_time_get_us() - p_event->time_us));
+      }
+      tail++;
+    }
 
-  p_keyboard->queue_pos = 0;
+    /* Hand the slots back to the system thread. */
+    __atomic_store_n(&p_keyboard->queue_tail, tail, __ATOMIC_RELEASE);
 
-  os_lock_unlock(p_keyboard->p_lock);
+    keyboard_apply_physical_keys(p_keyboard, keys, is_downs, num_keys);
 
-  keyboard_apply_physical_keys(p_keyboard, keys, is_downs, num_keys);
+    head = __atomic_load_n(&p_keyboard->queue_head, __ATOMIC_ACQUIRE);
+  }
 }
 
 void
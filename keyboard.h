@@ -48,6 +48,11 @@ void keyboard_destroy(struct keyboard_struct* p_keyboard);
 void keyboard_set_virtual_updated_callback(struct keyboard_struct* p_keyboard,
                                            void (*p_callback)(void*),
                                            void* p_callback_object);
+void keyboard_set_physical_updated_callback(struct keyboard_struct* p_keyboard,
+                                            void (*p_callback)(void*),
+                                            void* p_callback_object);
+void keyboard_set_poll_cycles(struct keyboard_struct* p_keyboard,
+                              uint64_t poll_cycles);
 void keyboard_set_fast_mode_callback(struct keyboard_struct* p_keyboard,
                                      void (*p_set_fast_mode_callback)(void* p,
                                                                       int fast),
@@ -7,11 +7,14 @@
 #include "os_poller.h"
 #include "os_sound.h"
 #include "os_terminal.h"
+#include "os_time.h"
 #include "os_window.h"
 #include "render.h"
+#include "render_scale.h"
 #include "serial.h"
 #include "sound.h"
 #include "state.h"
+#include "state_hash.h"
 #include "test.h"
 #include "util.h"
 #include "version.h"
@@ -32,6 +35,19 @@ enum {
   k_max_tapes = 4,
 };
 
+struct main_frame_context {
+  struct video_struct* p_video;
+  struct render_struct* p_render;
+  struct render_scale_struct* p_scale;
+  struct os_window_struct* p_window;
+  int window_open;
+  const char* p_frames_dir;
+  uint64_t frame_cycles;
+  uint32_t max_frames;
+  uint32_t save_frame_count;
+  int is_exit_on_max_frames_flag;
+};
+
 static void
 main_save_frame(const char* p_frames_dir,
                 uint32_t save_frame_count,
@@ -40,22 +56,86 @@ main_save_frame(const char* p_frames_dir,
   struct util_file* p_file;
   uint32_t* p_buffer = render_get_buffer(p_render);
   uint32_t size = render_get_buffer_size(p_render);
+  int is_indexed = (render_get_pixel_format(p_render) ==
+                    k_render_pixel_format_index);
 
   (void) snprintf(file_name,
                   sizeof(file_name),
-                  "%s/beebjit_frame_%d.bgra",
+                  "%s/beebjit_frame_%d.%s",
                   p_frames_dir,
-                  save_frame_count);
+                  save_frame_count,
+                  (is_indexed ? "idx" : "bgra"));
   p_file = util_file_open(&file_name[0], 1, 1);
   if (p_file == NULL) {
     util_bail("util_file_open failed");
   }
 
-  util_file_write(p_file, p_buffer, size);
+  if (is_indexed) {
+    /* One byte per pixel, the physical color. */
+    uint32_t i;
+    uint32_t num_pixels = (size / 4);
+    uint8_t* p_indexes = util_malloc(num_pixels);
+    for (i = 0; i < num_pixels; ++i) {
+      p_indexes[i] = p_buffer[i];
+    }
+    util_file_write(p_file, p_indexes, num_pixels);
+    util_free(p_indexes);
+  } else {
+    util_file_write(p_file, p_buffer, size);
+  }
 
   util_file_close(p_file);
 }
 
+static void
+main_handle_vsync(void* p,
+                  int do_full_render,
+                  int framing_changed,
+                  uint64_t cycles) {
+  struct main_frame_context* p_context = (struct main_frame_context*) p;
+  struct render_struct* p_render = p_context->p_render;
+  int save_frame = 0;
+
+  if ((p_context->frame_cycles > 0) &&
+      (cycles >= p_context->frame_cycles) &&
+      (p_context->save_frame_count < p_context->max_frames)) {
+    save_frame = 1;
+  }
+  if (!p_context->window_open && !save_frame) {
+    return;
+  }
+
+  if (do_full_render) {
+    video_render_full_frame(p_context->p_video);
+  }
+  render_process_full_buffer(p_render);
+  if (p_context->window_open) {
+    if (p_context->p_scale != NULL) {
+      render_scale_process(p_context->p_scale,
+                           os_window_get_buffer(p_context->p_window),
+                           render_get_buffer(p_render));
+    }
+    os_window_sync_buffer_to_screen(p_context->p_window);
+  }
+  if (save_frame) {
+    main_save_frame(p_context->p_frames_dir,
+                    p_context->save_frame_count,
+                    p_render);
+    p_context->save_frame_count++;
+    if (p_context->is_exit_on_max_frames_flag &&
+        (p_context->save_frame_count == p_context->max_frames)) {
+      exit(0);
+    }
+  }
+  if (framing_changed) {
+    /* NOTE: in accurate mode, it would be more correct to clear the
+     * buffer from the framing change to the end of that frame, as well
+     * as for the next frame.
+     */
+    render_clear_buffer(p_render);
+  }
+}
+
 int
 main(int argc, const char* argv[]) {
   int i_args;
@@ -64,17 +144,17 @@ main(int argc, const char* argv[]) {
   uint8_t load_rom[k_bbc_rom_size];
   uint32_t i;
   uint32_t j;
-  struct os_poller_struct* p_poller;
+  struct main_frame_context frame_context;
+  struct os_poller_struct* p_poller = NULL;
   struct bbc_struct* p_bbc;
   struct keyboard_struct* p_keyboard;
-  struct video_struct* p_video;
   struct render_struct* p_render;
   uint32_t run_result;
   uint32_t* p_render_buffer;
-  intptr_t handle_channel_read_ui;
-  intptr_t handle_channel_write_bbc;
-  intptr_t handle_channel_read_bbc;
-  intptr_t handle_channel_write_ui;
+  intptr_t handle_channel_read_ui = -1;
+  intptr_t handle_channel_write_bbc = -1;
+  intptr_t handle_channel_read_bbc = -1;
+  intptr_t handle_channel_write_ui = -1;
   char* p_opt_flags;
   char* p_log_flags;
 
@@ -94,12 +174,16 @@ main(int argc, const char* argv[]) {
   const char* p_create_hfe_spec = NULL;
   const char* p_frames_dir = ".";
   const char* p_commands = NULL;
+  const char* p_state_hash_log = NULL;
+  const char* p_state_hash_compare_1 = NULL;
+  const char* p_state_hash_compare_2 = NULL;
   int debug_flag = 0;
   int run_flag = 0;
   int print_flag = 0;
   int fast_flag = 0;
   int test_flag = 0;
   int accurate_flag = 0;
+  int deterministic_flag = 0;
   int test_map_flag = 0;
   int disc_writeable_flag = 0;
   int disc_mutable_flag = 0;
@@ -121,15 +205,20 @@ main(int argc, const char* argv[]) {
   int mode = k_cpu_mode_jit;
   uint64_t cycles = 0;
   uint32_t expect = 0;
-  int window_open = 0;
   uint32_t num_discs_0 = 0;
   uint32_t num_discs_1 = 0;
   uint32_t num_tapes = 0;
   int keyboard_links = -1;
-  uint32_t save_frame_count = 0;
   uint64_t frame_cycles = 0;
   uint32_t max_frames = 1;
+  double speed_multiplier = 1.0;
   int is_exit_on_max_frames_flag = 0;
+  uint64_t startup_begin_us;
+  uint64_t startup_created_us;
+  uint64_t startup_loaded_us;
+  uint64_t startup_reset_us;
+
+  startup_begin_us = os_time_get_us();
 
   p_opt_flags = util_mallocz(1);
   p_log_flags = util_mallocz(1);
@@ -158,6 +247,10 @@ main(int argc, const char* argv[]) {
       }
       rom_names[bank] = val2;
       i_args += 2;
+    } else if (has_2 && (!strcmp(arg, "-state-hash-compare"))) {
+      p_state_hash_compare_1 = val1;
+      p_state_hash_compare_2 = val2;
+      i_args += 2;
     } else if (has_2 && (!strcmp(arg, "-create-hfe"))) {
       p_create_hfe_file = val1;
       p_create_hfe_spec = val2;
@@ -248,6 +341,12 @@ main(int argc, const char* argv[]) {
     } else if (has_1 && !strcmp(arg, "-max-frames")) {
       (void) sscanf(val1, "%"PRIu32, &max_frames);
       ++i_args;
+    } else if (has_1 && !strcmp(arg, "-speed")) {
+      (void) sscanf(val1, "%lf", &speed_multiplier);
+      ++i_args;
+    } else if (has_1 && !strcmp(arg, "-state-hash-log")) {
+      p_state_hash_log = val1;
+      ++i_args;
     } else if (has_1 && !strcmp(arg, "-frames-dir")) {
       p_frames_dir = val1;
       ++i_args;
@@ -276,6 +375,8 @@ main(int argc, const char* argv[]) {
       test_map_flag = 1;
     } else if (!strcmp(arg, "-accurate")) {
       accurate_flag = 1;
+    } else if (!strcmp(arg, "-deterministic")) {
+      deterministic_flag = 1;
     } else if (!strcmp(arg, "-writeable")) {
       disc_writeable_flag = 1;
     } else if (!strcmp(arg, "-mutable")) {
@@ -359,6 +460,10 @@ main(int argc, const char* argv[]) {
 "-max-frames     <m>: max frame images to save, default 1.\n"
 "-exit-on-max-frames: exit the process once max-frames is hit.\n"
 "-frames-dir     <d>: directory for frame files, default '.'.\n"
+"-speed          <m>: run at <m> times real time, e.g. 4 or 0.5.\n"
+"-deterministic     : no wall clock inputs; log periodic state hashes.\n"
+"-state-hash-log <f>: write periodic state hashes to file <f>.\n"
+"-state-hash-compare <f1> <f2>: report where two state hash logs diverge.\n"
 "-watford           : for a model B with a 1770, load Watford DDFS ROM.\n"
 "-opus              : for a model B with a 1770, load Opus DDOS ROM.\n"
 "-extended-roms     : disable ROM slot aliasing.\n"
@@ -372,6 +477,11 @@ main(int argc, const char* argv[]) {
     }
   }
 
+  if (p_state_hash_compare_1 != NULL) {
+    exit(state_hash_compare_logs(p_state_hash_compare_1,
+                                 p_state_hash_compare_2));
+  }
+
   (void) memset(os_rom, '\0', k_bbc_rom_size);
   (void) memset(load_rom, '\0', k_bbc_rom_size);
 
@@ -413,6 +523,7 @@ main(int argc, const char* argv[]) {
                      print_flag,
                      fast_flag,
                      accurate_flag,
+                     deterministic_flag,
                      fasttape_flag,
                      test_map_flag,
                      p_opt_flags,
@@ -421,6 +532,7 @@ main(int argc, const char* argv[]) {
   if (p_bbc == NULL) {
     util_bail("bbc_create failed");
   }
+  startup_created_us = os_time_get_us();
 
   if (test_flag) {
     test_do_tests(p_bbc);
@@ -531,26 +643,94 @@ main(int argc, const char* argv[]) {
   if (autoboot_flag) {
     bbc_set_autoboot(p_bbc, 1);
   }
+  if (p_state_hash_log != NULL) {
+    bbc_set_state_hash_log(p_bbc, p_state_hash_log);
+  }
+  if (speed_multiplier != 1.0) {
+    bbc_set_speed_multiplier(p_bbc, speed_multiplier);
+  }
 
   p_render = bbc_get_render(p_bbc);
 
-  p_poller = os_poller_create();
-  if (p_poller == NULL) {
-    util_bail("os_poller_create failed");
-  }
+  (void) memset(&frame_context, '\0', sizeof(frame_context));
+  frame_context.p_video = bbc_get_video(p_bbc);
+  frame_context.p_render = p_render;
+  frame_context.p_frames_dir = p_frames_dir;
+  frame_context.frame_cycles = frame_cycles;
+  frame_context.max_frames = max_frames;
+  frame_context.is_exit_on_max_frames_flag = is_exit_on_max_frames_flag;
 
+  if (!headless_flag &&
+      (render_get_pixel_format(p_render) != k_render_pixel_format_bgra)) {
+    util_bail("video:pixel-format=index needs -headless");
+  }
   if (!headless_flag) {
-    p_window = os_window_create(render_get_width(p_render),
-                                render_get_height(p_render));
+    uint32_t render_width = render_get_width(p_render);
+    uint32_t render_height = render_get_height(p_render);
+    uint32_t window_scale = 1;
+    uint32_t window_width = 0;
+    uint32_t window_height = 0;
+    uint32_t scanline_percent = 0;
+    int is_crt = util_has_option(p_opt_flags, "video:crt");
+    int is_scaled = 0;
+
+    /* Scaling and scanline effects are a post-render stage into the window
+     * buffer, done on the UI thread.
+     */
+    is_scaled |= util_get_u32_option(&window_scale,
+                                     p_opt_flags,
+                                     "video:scale=");
+    is_scaled |= util_get_u32_option(&window_width,
+                                     p_opt_flags,
+                                     "video:window-width=");
+    is_scaled |= util_get_u32_option(&window_height,
+                                     p_opt_flags,
+                                     "video:window-height=");
+    if (is_crt) {
+      scanline_percent = 40;
+    }
+    (void) util_get_u32_option(&scanline_percent,
+                               p_opt_flags,
+                               "video:scanlines=");
+    if ((window_scale == 0) || (window_scale > 8)) {
+      util_bail("scale must be 1-8");
+    }
+    /* Given just one dimension, keep the aspect ratio. */
+    if ((window_width == 0) && (window_height == 0)) {
+      window_width = (render_width * window_scale);
+      window_height = (render_height * window_scale);
+    } else if (window_width == 0) {
+      window_width = ((uint64_t) window_height * render_width / render_height);
+    } else if (window_height == 0) {
+      window_height = ((uint64_t) window_width * render_height / render_width);
+    }
+    if (is_scaled || (scanline_percent > 0)) {
+      frame_context.p_scale = render_scale_create(render_width,
+                                                  render_height,
+                                                  window_width,
+                                                  window_height,
+                                                  scanline_percent,
+                                                  is_crt);
+    } else {
+      window_width = render_width;
+      window_height = render_height;
+    }
+
+    p_window = os_window_create(window_width, window_height);
     if (p_window == NULL) {
       util_bail("os_window_create failed");
     }
-    window_open = 1;
+    frame_context.p_window = p_window;
+    frame_context.window_open = 1;
     os_window_set_name(p_window, "beebjit technology preview");
     os_window_set_keyboard_callback(p_window, p_keyboard);
     os_window_set_focus_lost_callback(p_window, bbc_focus_lost_callback, p_bbc);
-    p_render_buffer = os_window_get_buffer(p_window);
-    render_set_buffer(p_render, p_render_buffer);
+    if (frame_context.p_scale != NULL) {
+      render_create_internal_buffer(p_render);
+    } else {
+      p_render_buffer = os_window_get_buffer(p_window);
+      render_set_buffer(p_render, p_render_buffer);
+    }
 
     window_handle = os_window_get_handle(p_window);
   } else if (frame_cycles > 0) {
@@ -591,17 +771,47 @@ main(int argc, const char* argv[]) {
     serial_set_io_handles(p_serial, stdin_handle, stdout_handle);
   }
 
-  os_channel_get_handles(&handle_channel_read_ui,
-                         &handle_channel_write_bbc,
-                         &handle_channel_read_bbc,
-                         &handle_channel_write_ui);
-  bbc_set_channel_handles(p_bbc,
-                          handle_channel_read_bbc,
-                          handle_channel_write_bbc,
-                          handle_channel_read_ui,
-                          handle_channel_write_ui);
+  if (headless_flag &&
+      !util_has_option(p_opt_flags, "video:render-unobserved")) {
+    /* Only frames being saved are looked at. */
+    uint64_t first_observed_ticks = UINT64_MAX;
+    if (frame_cycles > 0) {
+      first_observed_ticks = frame_cycles;
+    }
+    video_set_first_observed_ticks(frame_context.p_video,
+                                   first_observed_ticks);
+  }
 
+  if (headless_flag) {
+    /* Headless runs have no UI thread at all. The CPU runs on this thread and
+     * any frame handling is done directly from the vsync callback.
+     */
+    bbc_set_vsync_callback(p_bbc, main_handle_vsync, &frame_context);
+  } else {
+    os_channel_get_handles(&handle_channel_read_ui,
+                           &handle_channel_write_bbc,
+                           &handle_channel_read_bbc,
+                           &handle_channel_write_ui);
+    bbc_set_channel_handles(p_bbc,
+                            handle_channel_read_bbc,
+                            handle_channel_write_bbc,
+                            handle_channel_read_ui,
+                            handle_channel_write_ui);
+  }
+
+  startup_loaded_us = os_time_get_us();
   bbc_power_on_reset(p_bbc);
+  startup_reset_us = os_time_get_us();
+  if (util_has_option(p_log_flags, "perf:startup")) {
+    log_do_log(k_log_perf,
+               k_log_info,
+               "startup: create %"PRIu64"us, load %"PRIu64"us, "
+               "reset %"PRIu64"us, total %"PRIu64"us",
+               (startup_created_us - startup_begin_us),
+               (startup_loaded_us - startup_created_us),
+               (startup_reset_us - startup_loaded_us),
+               (startup_reset_us - startup_begin_us));
+  }
 
   /* Can only set the PC after the bbc_power_on_reset reset call, otherwise the
    * 6502 reset will clobber it.
@@ -610,24 +820,27 @@ main(int argc, const char* argv[]) {
     bbc_set_pc(p_bbc, pc);
   }
 
-  bbc_run_async(p_bbc);
+  if (headless_flag) {
+    bbc_run_sync(p_bbc);
+  } else {
+    p_poller = os_poller_create();
+    if (p_poller == NULL) {
+      util_bail("os_poller_create failed");
+    }
 
-  os_poller_add_handle(p_poller, handle_channel_read_ui);
-  if (window_handle != -1) {
-    os_poller_add_handle(p_poller, window_handle);
-  }
+    bbc_run_async(p_bbc);
 
-  p_video = bbc_get_video(p_bbc);
+    os_poller_add_handle(p_poller, handle_channel_read_ui);
+    if (window_handle != -1) {
+      os_poller_add_handle(p_poller, window_handle);
+    }
+  }
 
-  while (1) {
+  while (p_poller != NULL) {
     os_poller_poll(p_poller);
 
     if (os_poller_handle_triggered(p_poller, 0)) {
       struct bbc_message message;
-      int do_full_render;
-      int framing_changed;
-      int save_frame;
-      uint64_t cycles;
 
       bbc_client_receive_message(p_bbc, &message);
       if (message.data[0] == k_message_exited) {
@@ -635,49 +848,22 @@ main(int argc, const char* argv[]) {
       }
 
       assert(message.data[0] == k_message_vsync);
-      do_full_render = message.data[1];
-      framing_changed = message.data[2];
-      cycles = message.data[3];
-      save_frame = 0;
-      if ((frame_cycles > 0) &&
-          (cycles >= frame_cycles) &&
-          (save_frame_count < max_frames)) {
-        save_frame = 1;
-      }
-      if (window_open || save_frame) {
-        if (do_full_render) {
-          video_render_full_frame(p_video);
-        }
-        render_process_full_buffer(p_render);
-        if (window_open) {
-          os_window_sync_buffer_to_screen(p_window);
-        }
-        if (save_frame) {
-          main_save_frame(p_frames_dir, save_frame_count, p_render);
-          save_frame_count++;
-          if (is_exit_on_max_frames_flag && (save_frame_count == max_frames)) {
-            exit(0);
-          }
-        }
-        if (framing_changed) {
-          /* NOTE: in accurate mode, it would be more correct to clear the
-           * buffer from the framing change to the end of that frame, as well
-           * as for the next frame.
-           */
-          render_clear_buffer(p_render);
-        }
-      }
+      main_handle_vsync(&frame_context,
+                        message.data[1],
+                        message.data[2],
+                        message.data[3]);
       if (bbc_get_vsync_wait_for_render(p_bbc)) {
         message.data[0] = k_message_render_done;
         bbc_client_send_message(p_bbc, &message);
       }
     }
 
-    if (window_open && os_poller_handle_triggered(p_poller, 1)) {
+    if (frame_context.window_open &&
+        os_poller_handle_triggered(p_poller, 1)) {
       os_window_process_events(p_window);
       if (os_window_is_closed(p_window)) {
         struct cpu_driver* p_cpu_driver = bbc_get_cpu_driver(p_bbc);
-        window_open = 0;
+        frame_context.window_open = 0;
         if (!(p_cpu_driver->p_funcs->get_flags(p_cpu_driver) &
               k_cpu_flag_exited)) {
           p_cpu_driver->p_funcs->apply_flags(p_cpu_driver,
@@ -696,16 +882,23 @@ main(int argc, const char* argv[]) {
     }
   }
 
-  os_poller_destroy(p_poller);
+  if (p_poller != NULL) {
+    os_poller_destroy(p_poller);
+  }
   if (p_window != NULL) {
     os_window_destroy(p_window);
   }
+  if (frame_context.p_scale != NULL) {
+    render_scale_destroy(frame_context.p_scale);
+  }
   bbc_destroy(p_bbc);
 
-  os_channel_free_handles(handle_channel_read_ui,
-                          handle_channel_write_bbc,
-                          handle_channel_read_bbc,
-                          handle_channel_write_ui);
+  if (handle_channel_read_ui != -1) {
+    os_channel_free_handles(handle_channel_read_ui,
+                            handle_channel_write_bbc,
+                            handle_channel_read_bbc,
+                            handle_channel_write_ui);
+  }
 
   if (p_sound_driver != NULL) {
     os_sound_destroy(p_sound_driver);
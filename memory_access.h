@@ -13,6 +13,11 @@ struct memory_access {
   uint16_t (*memory_write_needs_callback_from)(void* p);
   int (*memory_read_needs_callback)(void* p, uint16_t addr);
   int (*memory_write_needs_callback)(void* p, uint16_t addr);
+  /* For an address that needs a read callback, returns non-zero if the read
+   * mapping holds an up to date copy of the value and the read has no side
+   * effects. Timing effects of the access are not modeled by such a read.
+   */
+  int (*memory_read_has_snapshot)(void* p, uint16_t addr);
 
   uint8_t (*memory_read_callback)(void* p,
                                   uint16_t addr,
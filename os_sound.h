@@ -18,6 +18,10 @@ int os_sound_init(struct os_sound_struct* p_driver);
 uint32_t os_sound_get_sample_rate(struct os_sound_struct* p_driver);
 uint32_t os_sound_get_buffer_size(struct os_sound_struct* p_driver);
 uint32_t os_sound_get_period_size(struct os_sound_struct* p_driver);
+/* Frames written but not yet played. Writing at most buffer size minus this
+ * won't block.
+ */
+uint32_t os_sound_get_frames_queued(struct os_sound_struct* p_driver);
 
 void os_sound_write(struct os_sound_struct* p_driver,
                     int16_t* p_frames,
@@ -1,6 +1,7 @@
 #include "os_sound.h"
 
 #include "log.h"
+#include "os_time.h"
 #include "util.h"
 
 #include <alsa/asoundlib.h>
@@ -12,6 +13,7 @@
 #include <string.h>
 
 static const char* k_os_sound_default_device = "default";
+static const char* k_os_sound_file_prefix = "@file:";
 /* NOTE: used to be 512, a bit aggressive but it seemed to work on my old
  * laptop mostly. 2048 is still much better than e.g. jsbeeb, b-em, but has
  * some headroom for even slower devices.
@@ -26,6 +28,14 @@ struct os_sound_struct {
   uint32_t period_size;
   snd_pcm_t* playback_handle;
   pa_simple* p_pa;
+
+  /* Sink that plays in real time without a device, optionally writing the
+   * frames to a file. It works headless and in CI.
+   */
+  int is_sink;
+  FILE* p_sink_file;
+  struct os_time_sleeper* p_sink_sleeper;
+  double sink_end_us;
 };
 
 uint32_t
@@ -70,6 +80,15 @@ os_sound_destroy(struct os_sound_struct* p_driver) {
     }
     pa_simple_free(p_driver->p_pa);
   }
+  if (p_driver->p_sink_file != NULL) {
+    int ret = fclose(p_driver->p_sink_file);
+    if (ret != 0) {
+      util_bail("fclose failed");
+    }
+  }
+  if (p_driver->p_sink_sleeper != NULL) {
+    os_time_free_sleeper(p_driver->p_sink_sleeper);
+  }
 
   free(p_driver->p_device_name);
 
@@ -126,6 +145,35 @@ os_sound_init_pulse(struct os_sound_struct* p_driver) {
   return 0;
 }
 
+static int
+os_sound_init_sink(struct os_sound_struct* p_driver) {
+  const char* p_device_name = p_driver->p_device_name;
+  size_t prefix_len = strlen(k_os_sound_file_prefix);
+
+  if (strncmp(p_device_name, k_os_sound_file_prefix, prefix_len) == 0) {
+    const char* p_file_name = (p_device_name + prefix_len);
+    p_driver->p_sink_file = fopen(p_file_name, "wb");
+    if (p_driver->p_sink_file == NULL) {
+      log_do_log(k_log_audio, k_log_warning, "can't open %s", p_file_name);
+      return -1;
+    }
+  }
+
+  p_driver->is_sink = 1;
+  p_driver->period_size = (p_driver->buffer_size / p_driver->num_periods);
+  p_driver->p_sink_sleeper = os_time_create_sleeper(0);
+  p_driver->sink_end_us = os_time_get_us();
+
+  log_do_log(k_log_audio,
+             k_log_info,
+             "sink: %s, rate %d, buffer %d",
+             p_device_name,
+             (int) p_driver->sample_rate,
+             (int) p_driver->buffer_size);
+
+  return 0;
+}
+
 static int
 os_sound_init_alsa(struct os_sound_struct* p_driver) {
   int ret;
@@ -308,8 +356,14 @@ os_sound_init_alsa(struct os_sound_struct* p_driver) {
 
 int
 os_sound_init(struct os_sound_struct* p_driver) {
-  if (strcmp(p_driver->p_device_name, "@pulse") == 0) {
+  const char* p_device_name = p_driver->p_device_name;
+  if (strcmp(p_device_name, "@pulse") == 0) {
     return os_sound_init_pulse(p_driver);
+  } else if ((strcmp(p_device_name, "@null") == 0) ||
+             (strncmp(p_device_name,
+                      k_os_sound_file_prefix,
+                      strlen(k_os_sound_file_prefix)) == 0)) {
+    return os_sound_init_sink(p_driver);
   } else {
     return os_sound_init_alsa(p_driver);
   }
@@ -340,6 +394,73 @@ os_sound_handle_xrun(struct os_sound_struct* p_driver) {
   }
 }
 
+static uint32_t
+os_sound_get_sink_frames_queued(struct os_sound_struct* p_driver) {
+  double curr_time_us = os_time_get_us();
+  double queued_us = (p_driver->sink_end_us - curr_time_us);
+
+  if (queued_us <= 0.0) {
+    return 0;
+  }
+  return (uint32_t) ((queued_us * p_driver->sample_rate) / 1000000.0);
+}
+
+uint32_t
+os_sound_get_frames_queued(struct os_sound_struct* p_driver) {
+  snd_pcm_sframes_t avail;
+
+  if (p_driver->is_sink) {
+    return os_sound_get_sink_frames_queued(p_driver);
+  } else if (p_driver->p_pa != NULL) {
+    int error = 0;
+    pa_usec_t latency = pa_simple_get_latency(p_driver->p_pa, &error);
+    return (uint32_t) ((latency * p_driver->sample_rate) / 1000000);
+  }
+
+  avail = snd_pcm_avail(p_driver->playback_handle);
+  if (avail < 0) {
+    if (avail == -EPIPE) {
+      os_sound_handle_xrun(p_driver);
+    }
+    return 0;
+  }
+  if ((uint32_t) avail >= p_driver->buffer_size) {
+    return 0;
+  }
+  return (p_driver->buffer_size - avail);
+}
+
+static void
+os_sound_write_sink(struct os_sound_struct* p_driver,
+                    int16_t* p_frames,
+                    uint32_t num_frames) {
+  double curr_time_us = os_time_get_us();
+  double us_per_frame = (1000000.0 / p_driver->sample_rate);
+  uint32_t frames_queued = os_sound_get_sink_frames_queued(p_driver);
+
+  /* Block like a device would, until the frames fit. */
+  if ((frames_queued + num_frames) > p_driver->buffer_size) {
+    double wait_until_us = (p_driver->sink_end_us -
+                            ((p_driver->buffer_size - num_frames) *
+                             us_per_frame));
+    curr_time_us =
+        os_time_sleeper_sleep_until_us(p_driver->p_sink_sleeper,
+                                       (uint64_t) wait_until_us);
+  }
+  /* An underrun: the sink restarts from now. */
+  if (p_driver->sink_end_us < curr_time_us) {
+    p_driver->sink_end_us = curr_time_us;
+  }
+  p_driver->sink_end_us += (num_frames * us_per_frame);
+
+  if (p_driver->p_sink_file != NULL) {
+    size_t ret = fwrite(p_frames, 2, num_frames, p_driver->p_sink_file);
+    if (ret != num_frames) {
+      util_bail("fwrite failed");
+    }
+  }
+}
+
 static void
 os_sound_write_pulse(struct os_sound_struct* p_driver,
                      int16_t* p_frames,
@@ -390,9 +511,13 @@ void
 os_sound_write(struct os_sound_struct* p_driver,
                int16_t* p_frames,
                uint32_t num_frames) {
-  assert((p_driver->playback_handle != NULL) || (p_driver->p_pa != NULL));
+  assert((p_driver->playback_handle != NULL) ||
+         (p_driver->p_pa != NULL) ||
+         p_driver->is_sink);
 
-  if (p_driver->p_pa != NULL) {
+  if (p_driver->is_sink) {
+    os_sound_write_sink(p_driver, p_frames, num_frames);
+  } else if (p_driver->p_pa != NULL) {
     os_sound_write_pulse(p_driver, p_frames, num_frames);
   } else {
     os_sound_write_alsa(p_driver, p_frames, num_frames);
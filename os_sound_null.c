@@ -55,6 +55,13 @@ os_sound_get_period_size(struct os_sound_struct* p_driver) {
   return 0;
 }
 
+uint32_t
+os_sound_get_frames_queued(struct os_sound_struct* p_driver) {
+  (void) p_driver;
+  util_bail("headless");
+  return 0;
+}
+
 void
 os_sound_write(struct os_sound_struct* p_driver,
                int16_t* p_frames,
@@ -198,6 +198,27 @@ os_sound_get_period_size(struct os_sound_struct* p_driver) {
   return p_driver->frames_per_period;
 }
 
+uint32_t
+os_sound_get_frames_queued(struct os_sound_struct* p_driver) {
+  uint32_t i;
+
+  uint32_t frames_queued = 0;
+
+  /* Period granularity, plus the partially filled period. The WHDR_INQUEUE
+   * flags are cleared from the callback thread, which is a benign race.
+   */
+  for (i = 0; i < p_driver->num_periods; ++i) {
+    if (p_driver->wav_headers[i].dwFlags & WHDR_INQUEUE) {
+      frames_queued += p_driver->frames_per_period;
+    }
+  }
+  if (p_driver->is_filling) {
+    frames_queued += p_driver->fill_frames_pos;
+  }
+
+  return frames_queued;
+}
+
 void
 os_sound_write(struct os_sound_struct* p_driver,
                int16_t* p_frames,
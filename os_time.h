@@ -7,8 +7,12 @@ struct os_time_sleeper;
 
 uint64_t os_time_get_us(void);
 
-struct os_time_sleeper* os_time_create_sleeper(void);
+struct os_time_sleeper* os_time_create_sleeper(uint32_t spin_us);
 void os_time_free_sleeper(struct os_time_sleeper* p_sleeper);
-void os_time_sleeper_sleep_us(struct os_time_sleeper* p_sleeper, uint64_t us);
+/* Sleeps until deadline_us, in os_time_get_us() time, and returns the actual
+ * wakeup time.
+ */
+uint64_t os_time_sleeper_sleep_until_us(struct os_time_sleeper* p_sleeper,
+                                        uint64_t deadline_us);
 
 #endif /* BEEBJIT_OS_TIME_H */
@@ -5,6 +5,10 @@
 #include <errno.h>
 #include <time.h>
 
+struct os_time_sleeper {
+  uint32_t spin_us;
+};
+
 uint64_t
 os_time_get_us() {
   struct timespec ts;
@@ -18,32 +22,50 @@ os_time_get_us() {
 }
 
 struct os_time_sleeper*
-os_time_create_sleeper(void) {
-  return NULL;
+os_time_create_sleeper(uint32_t spin_us) {
+  struct os_time_sleeper* p_ret =
+      util_mallocz(sizeof(struct os_time_sleeper));
+
+  p_ret->spin_us = spin_us;
+
+  return p_ret;
 }
 
 void
 os_time_free_sleeper(struct os_time_sleeper* p_sleeper) {
-  (void) p_sleeper;
+  util_free(p_sleeper);
 }
 
-void
-os_time_sleeper_sleep_us(struct os_time_sleeper* p_sleeper, uint64_t us) {
+uint64_t
+os_time_sleeper_sleep_until_us(struct os_time_sleeper* p_sleeper,
+                               uint64_t deadline_us) {
   int ret;
   struct timespec ts;
+  uint64_t curr_time_us;
 
-  (void) p_sleeper;
+  /* Sleep to an absolute deadline on the same clock as os_time_get_us(), so
+   * that the time taken to get here, and any lateness of the previous wakeup,
+   * doesn't push the wakeup back.
+   * The optional spin tail wakes up early and polls the clock for the last
+   * stretch, because kernel wakeups are commonly tens of us late.
+   */
+  if (deadline_us > p_sleeper->spin_us) {
+    uint64_t sleep_until_us = (deadline_us - p_sleeper->spin_us);
+    ts.tv_sec = (sleep_until_us / 1000000);
+    ts.tv_nsec = ((sleep_until_us % 1000000) * 1000);
 
-  ts.tv_sec = (us / 1000000);
-  ts.tv_nsec = ((us % 1000000) * 1000);
+    do {
+      /* NOTE: returns the error rather than setting errno. */
+      ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+      if ((ret != 0) && (ret != EINTR)) {
+        util_bail("clock_nanosleep failed");
+      }
+    } while (ret != 0);
+  }
 
   do {
-    ret = nanosleep(&ts, &ts);
-    if (ret != 0) {
-      if (errno == EINTR) {
-        continue;
-      }
-      util_bail("nanosleep failed");
-    }
-  } while (ret != 0);
+    curr_time_us = os_time_get_us();
+  } while (curr_time_us < deadline_us);
+
+  return curr_time_us;
 }
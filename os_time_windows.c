@@ -10,6 +10,7 @@ uint64_t s_frequency;
 
 struct os_time_sleeper {
   HANDLE handle;
+  uint32_t spin_us;
 };
 
 uint64_t
@@ -43,7 +44,7 @@ os_time_get_us() {
 }
 
 struct os_time_sleeper*
-os_time_create_sleeper(void) {
+os_time_create_sleeper(uint32_t spin_us) {
   HANDLE handle;
 
   struct os_time_sleeper* p_ret =
@@ -55,6 +56,7 @@ os_time_create_sleeper(void) {
   }
 
   p_ret->handle = handle;
+  p_ret->spin_us = spin_us;
 
   return p_ret;
 }
@@ -69,24 +71,42 @@ os_time_free_sleeper(struct os_time_sleeper* p_sleeper) {
   util_free(p_sleeper);
 }
 
-void
-os_time_sleeper_sleep_us(struct os_time_sleeper* p_sleeper, uint64_t us) {
+uint64_t
+os_time_sleeper_sleep_until_us(struct os_time_sleeper* p_sleeper,
+                               uint64_t deadline_us) {
   BOOL set_ret;
   DWORD wait_ret;
   LARGE_INTEGER li;
+  uint64_t curr_time_us;
 
   HANDLE handle = p_sleeper->handle;
+  uint64_t sleep_until_us = 0;
 
-  /* Unit of timer is 100ns. */
-  li.QuadPart = -(int64_t) (us * 10);
-
-  set_ret = SetWaitableTimer(handle, &li, 0, NULL, NULL, FALSE);
-  if (set_ret == 0) {
-    util_bail("SetWaitableTimer failed");
+  /* The waitable timer's absolute mode is on the wall clock, not the
+   * performance counter, so convert the deadline to a relative wait.
+   */
+  if (deadline_us > p_sleeper->spin_us) {
+    sleep_until_us = (deadline_us - p_sleeper->spin_us);
   }
+  curr_time_us = os_time_get_us();
+  if (curr_time_us < sleep_until_us) {
+    /* Unit of timer is 100ns. */
+    li.QuadPart = -(int64_t) ((sleep_until_us - curr_time_us) * 10);
+
+    set_ret = SetWaitableTimer(handle, &li, 0, NULL, NULL, FALSE);
+    if (set_ret == 0) {
+      util_bail("SetWaitableTimer failed");
+    }
 
-  wait_ret = WaitForSingleObject(handle, INFINITE);
-  if (wait_ret != WAIT_OBJECT_0) {
-    util_bail("WaitForSingleObject failed");
+    wait_ret = WaitForSingleObject(handle, INFINITE);
+    if (wait_ret != WAIT_OBJECT_0) {
+      util_bail("WaitForSingleObject failed");
+    }
   }
+
+  do {
+    curr_time_us = os_time_get_us();
+  } while (curr_time_us < deadline_us);
+
+  return curr_time_us;
 }
@@ -17,11 +17,27 @@
 
 #include <assert.h>
 #include <err.h>
+#include <inttypes.h>
 #include <pthread.h>
+#include <string.h>
 
 #include <sys/ipc.h>
 #include <sys/shm.h>
 
+enum {
+  k_os_window_num_images = 2,
+};
+
+struct os_window_image {
+  int shmid;
+  void* p_shm_map_start;
+  void* p_image_data;
+  XImage* p_image;
+  XShmSegmentInfo shm_info;
+  /* Put to the server and not yet reported complete. */
+  int is_pending;
+};
+
 struct os_window_struct {
   uint32_t width;
   uint32_t height;
@@ -31,12 +47,19 @@ struct os_window_struct {
   Display* d;
   Window w;
   GC gc;
+  /* The emulator renders into p_buffer. With MIT-SHM, each frame is copied
+   * into whichever shared image the server is done with and put
+   * asynchronously, with a ShmCompletion event saying when the server has
+   * finished reading it. There's no round trip per frame.
+   * Without MIT-SHM, there's a single image wrapping p_buffer; XPutImage
+   * copies the data into the request so that's asynchronous anyway.
+   */
+  uint32_t* p_buffer;
   int use_mit_shm;
-  int shmid;
-  void* p_shm_map_start;
-  void* p_image_data;
-  XImage* p_image;
-  XShmSegmentInfo shm_info;
+  int shm_completion_event_type;
+  struct os_window_image images[k_os_window_num_images];
+  uint32_t image_index;
+  uint64_t num_completion_waits;
   uint8_t* p_key_map;
   Atom atom_delete_message;
   int is_deleted;
@@ -46,48 +69,106 @@ static XErrorEvent s_last_error_event;
 static int s_got_last_error_event;
 
 static void
-rm_shmid(struct os_window_struct* p_window) {
+rm_shmid(struct os_window_image* p_image) {
   int ret;
 
-  assert(p_window->shmid != -1);
+  assert(p_image->shmid != -1);
 
-  ret = shmctl(p_window->shmid, IPC_RMID, NULL);
+  ret = shmctl(p_image->shmid, IPC_RMID, NULL);
   if (ret != 0) {
     errx(1, "shmctl failed");
   }
 
-  p_window->shmid = -1;
+  p_image->shmid = -1;
 }
 
 static void
-dt_shm(struct os_window_struct* p_window) {
+dt_shm(struct os_window_image* p_image) {
   int ret;
   
-  assert(p_window->p_shm_map_start != NULL);
+  assert(p_image->p_shm_map_start != NULL);
 
-  ret = shmdt(p_window->p_shm_map_start);
+  ret = shmdt(p_image->p_shm_map_start);
   if (ret != 0) {
     errx(1, "shmdt failed");
   }
 
-  p_window->p_shm_map_start = NULL;
-  p_window->p_image_data = NULL;
+  p_image->p_shm_map_start = NULL;
+  p_image->p_image_data = NULL;
 }
 
 static void
-destroy_image(struct os_window_struct* p_window) {
+destroy_image(struct os_window_image* p_image) {
   int ret;
 
-  assert(p_window->p_image != NULL);
+  assert(p_image->p_image != NULL);
   
-  ret = XDestroyImage(p_window->p_image);
+  ret = XDestroyImage(p_image->p_image);
   if (ret != 1) {
     errx(1, "XDestroyImage failed");
   }
 
-  p_window->p_image = NULL;
+  p_image->p_image = NULL;
 }  
 
+static void
+create_shm_image(struct os_window_struct* p_window,
+                 struct os_window_image* p_image,
+                 Visual* p_visual) {
+  Bool bool_ret;
+
+  uint32_t width = p_window->width;
+  uint32_t height = p_window->height;
+  size_t map_size = (width * height * 4);
+
+  /* Add in suitable extra size for guard pages, because I'm sure I'm going to
+   * write off the beginning or end one day.
+   */
+  if ((map_size % 4096) != 0) {
+    map_size += (4096 - (map_size % 4096));
+  }
+  map_size += (4096 * 2);
+
+  p_image->shmid = shmget(IPC_PRIVATE, map_size, (IPC_CREAT | 0600));
+  if (p_image->shmid < 0) {
+    errx(1, "shmget failed");
+  }
+  p_image->p_shm_map_start = shmat(p_image->shmid, NULL, 0);
+  if (p_image->p_shm_map_start == NULL) {
+    rm_shmid(p_image);
+    errx(1, "shmat failed");
+  }
+
+  os_alloc_make_mapping_none(p_image->p_shm_map_start, 4096);
+  os_alloc_make_mapping_none(p_image->p_shm_map_start + map_size - 4096, 4096);
+  p_image->p_image_data = (p_image->p_shm_map_start + 4096);
+
+  p_image->p_image = XShmCreateImage(p_window->d,
+                                     p_visual,
+                                     24,
+                                     ZPixmap,
+                                     NULL,
+                                     &p_image->shm_info,
+                                     width,
+                                     height);
+  if (p_image->p_image == NULL) {
+    rm_shmid(p_image);
+    errx(1, "XShmCreateImage failed");
+  }
+
+  p_image->shm_info.shmid = p_image->shmid;
+  p_image->shm_info.shmaddr = p_image->p_shm_map_start;
+  p_image->shm_info.readOnly = False;
+
+  p_image->p_image->data = p_image->p_image_data;
+
+  bool_ret = XShmAttach(p_window->d, &p_image->shm_info);
+  if (bool_ret != True) {
+    rm_shmid(p_image);
+    errx(1, "XShmAttach failed");
+  }
+}
+
 static int
 store_error_event_error_handler(Display* display, XErrorEvent* event) {
   (void) display;
@@ -120,7 +201,8 @@ os_window_create(uint32_t width, uint32_t height) {
   int ret;
   Visual* p_visual;
   int depth;
-  size_t map_size;
+  uint32_t i;
+  struct os_window_image* p_image;
   XErrorHandler old_error_handler;
   Status status_ret;
 
@@ -157,52 +239,10 @@ os_window_create(uint32_t width, uint32_t height) {
     errx(1, "default depth not 24");
   }
 
-  map_size = (width * height * 4);
-  /* Add in suitable extra size for guard pages, because I'm sure I'm going to
-   * write off the beginning or end one day.
-   */
-  if ((map_size % 4096) != 0) {
-    map_size += (4096 - (map_size % 4096));
-  }
-  map_size += (4096 * 2);
-
-  p_window->shmid = shmget(IPC_PRIVATE, map_size, (IPC_CREAT | 0600));
-  if (p_window->shmid < 0) {
-    errx(1, "shmget failed");
-  }
-  p_window->p_shm_map_start = shmat(p_window->shmid, NULL, 0);
-  if (p_window->p_shm_map_start == NULL) {
-    rm_shmid(p_window);
-    errx(1, "shmat failed");
-  }
-
-  os_alloc_make_mapping_none(p_window->p_shm_map_start, 4096);
-  os_alloc_make_mapping_none(p_window->p_shm_map_start + map_size - 4096, 4096);
-  p_window->p_image_data = (p_window->p_shm_map_start + 4096);
+  p_window->p_buffer = util_mallocz(width * height * 4);
 
-  p_window->p_image = XShmCreateImage(p_window->d,
-                                      p_visual,
-                                      24,
-                                      ZPixmap,
-                                      NULL,
-                                      &p_window->shm_info,
-                                      width,
-                                      height);
-  if (p_window->p_image == NULL) {
-    rm_shmid(p_window);
-    errx(1, "XShmCreateImage failed");
-  }
-
-  p_window->shm_info.shmid = p_window->shmid;
-  p_window->shm_info.shmaddr = p_window->p_shm_map_start;
-  p_window->shm_info.readOnly = False;
-
-  p_window->p_image->data = p_window->p_image_data;
-
-  bool_ret = XShmAttach(p_window->d, &p_window->shm_info);
-  if (bool_ret != True) {
-    rm_shmid(p_window);
-    errx(1, "XShmAttach failed");
+  for (i = 0; i < k_os_window_num_images; ++i) {
+    create_shm_image(p_window, &p_window->images[i], p_visual);
   }
 
   /* Don't let the shared memory leak if there's an error during XSync. */
@@ -213,7 +253,9 @@ os_window_create(uint32_t width, uint32_t height) {
   ret = XSync(p_window->d, False);
   (void) XSetErrorHandler(old_error_handler);
 
-  rm_shmid(p_window);
+  for (i = 0; i < k_os_window_num_images; ++i) {
+    rm_shmid(&p_window->images[i]);
+  }
   
   if (ret != 1) {
     errx(1, "XSync failed");
@@ -234,25 +276,26 @@ os_window_create(uint32_t width, uint32_t height) {
                  k_log_info,
                  "XShmAttach failure - not using MIT-SHM");
 
-      dt_shm(p_window);
-
-      destroy_image(p_window);
+      for (i = 0; i < k_os_window_num_images; ++i) {
+        dt_shm(&p_window->images[i]);
+        destroy_image(&p_window->images[i]);
+      }
 
       p_window->use_mit_shm = 0;
 
-      p_window->p_image_data = util_mallocz(width * height * 4);
-
-      p_window->p_image = XCreateImage(p_window->d,
-                                       p_visual,
-                                       24,
-                                       ZPixmap,
-                                       0,
-                                       p_window->p_image_data,
-                                       width,
-                                       height,
-                                       32,
-                                       (width * 4));
-      if (p_window->p_image == NULL) {
+      p_image = &p_window->images[0];
+      p_image->p_image_data = p_window->p_buffer;
+      p_image->p_image = XCreateImage(p_window->d,
+                                      p_visual,
+                                      24,
+                                      ZPixmap,
+                                      0,
+                                      p_image->p_image_data,
+                                      width,
+                                      height,
+                                      32,
+                                      (width * 4));
+      if (p_image->p_image == NULL) {
         errx(1, "XCreateImage failed");
       }
     } else {
@@ -316,6 +359,11 @@ os_window_create(uint32_t width, uint32_t height) {
     errx(1, "XFlush failed");
   }
 
+  if (p_window->use_mit_shm) {
+    p_window->shm_completion_event_type = (XShmGetEventBase(p_window->d) +
+                                           ShmCompletion);
+  }
+
   p_window->p_key_map = os_x11_keys_get_mapping();
 
   return p_window;
@@ -323,6 +371,7 @@ os_window_create(uint32_t width, uint32_t height) {
 
 void
 os_window_destroy(struct os_window_struct* p_window) {
+  uint32_t i;
   int ret;
   Bool bool_ret;
 
@@ -340,16 +389,18 @@ os_window_destroy(struct os_window_struct* p_window) {
   }
 
   if (p_window->use_mit_shm) {
-    bool_ret = XShmDetach(p_window->d, &p_window->shm_info);
-    if (bool_ret != True) {
-      errx(1, "XShmDetach failed");
+    for (i = 0; i < k_os_window_num_images; ++i) {
+      bool_ret = XShmDetach(p_window->d, &p_window->images[i].shm_info);
+      if (bool_ret != True) {
+        errx(1, "XShmDetach failed");
+      }
+      destroy_image(&p_window->images[i]);
+      dt_shm(&p_window->images[i]);
     }
-  }
-  
-  destroy_image(p_window);
-
-  if (p_window->use_mit_shm) {
-    dt_shm(p_window);
+  } else {
+    /* XDestroyImage would free the data, which is p_buffer. */
+    p_window->images[0].p_image->data = NULL;
+    destroy_image(&p_window->images[0]);
   }
 
   ret = XCloseDisplay(p_window->d);
@@ -357,6 +408,7 @@ os_window_destroy(struct os_window_struct* p_window) {
     errx(1, "XCloseDisplay failed");
   }
 
+  util_free(p_window->p_buffer);
   util_free(p_window);
 }
 
@@ -384,7 +436,7 @@ os_window_set_focus_lost_callback(struct os_window_struct* p_window,
 
 uint32_t*
 os_window_get_buffer(struct os_window_struct* p_window) {
-  return (uint32_t*) p_window->p_image_data;
+  return p_window->p_buffer;
 }
 
 intptr_t
@@ -395,31 +447,151 @@ os_window_get_handle(struct os_window_struct* p_window) {
   return fd;
 }
 
+static uint8_t
+os_window_convert_key_code(struct os_window_struct* p_window,
+                           uint32_t keycode) {
+  uint8_t* p_key_map = p_window->p_key_map;
+  uint8_t key = 0;
+
+  if (keycode < 256) {
+    key = p_key_map[keycode];
+  }
+
+  return key;
+}
+
+static void
+os_window_handle_event(struct os_window_struct* p_window, XEvent* p_event) {
+  struct keyboard_struct* p_keyboard = p_window->p_keyboard;
+  int keycode;
+  int key;
+
+  if (p_window->use_mit_shm &&
+      (p_event->type == p_window->shm_completion_event_type)) {
+    XShmCompletionEvent* p_completion = (XShmCompletionEvent*) p_event;
+    uint32_t i;
+    for (i = 0; i < k_os_window_num_images; ++i) {
+      if (p_completion->shmseg == p_window->images[i].shm_info.shmseg) {
+        p_window->images[i].is_pending = 0;
+      }
+    }
+    return;
+  }
+
+  switch (p_event->type) {
+  case KeyPress:
+    keycode = p_event->xkey.keycode;
+    key = os_window_convert_key_code(p_window, keycode);
+    if (key != 0) {
+      keyboard_system_key_pressed(p_keyboard, key);
+    } else {
+      log_do_log(k_log_keyboard,
+                 k_log_unimplemented,
+                 "unmapped key press %d",
+                 keycode);
+    }
+    break;
+  case KeyRelease:
+    keycode = p_event->xkey.keycode;
+    key = os_window_convert_key_code(p_window, keycode);
+    if (key != 0) {
+      keyboard_system_key_released(p_keyboard, key);
+    } else {
+      log_do_log(k_log_keyboard,
+                 k_log_unimplemented,
+                 "unmapped key release %d",
+                 keycode);
+    }
+    break;
+  case ClientMessage:
+    if ((Atom) p_event->xclient.data.l[0] == p_window->atom_delete_message) {
+      p_window->is_deleted = 1;
+    }
+    break;
+  case FocusOut:
+    if (p_window->p_focus_lost_callback) {
+      p_window->p_focus_lost_callback(p_window->p_focus_lost_callback_object);
+    }
+    break;
+  default:
+    /* Various events cannot be masked, so we just ignore them. */
+    break;
+  }
+}
+
+void
+os_window_process_events(struct os_window_struct* p_window) {
+  Display* d = p_window->d;
+
+  while (XPending(d) > 0) {
+    XEvent event;
+
+    int ret = XNextEvent(d, &event);
+    if (ret != 0) {
+      errx(1, "XNextEvent failed");
+    }
+
+    os_window_handle_event(p_window, &event);
+  }
+}
+
 void
 os_window_sync_buffer_to_screen(struct os_window_struct* p_window) {
   int ret;
 
+  struct os_window_image* p_image = &p_window->images[p_window->image_index];
+  size_t size = (p_window->width * p_window->height * 4);
+
   if (p_window->use_mit_shm) {
-    Bool bool_ret = XShmPutImage(p_window->d,
-                                 p_window->w,
-                                 p_window->gc,
-                                 p_window->p_image,
-                                 0,
-                                 0,
-                                 0,
-                                 0,
-                                 p_window->width,
-                                 p_window->height,
-                                 False);
+    Bool bool_ret;
+
+    /* This image was put two frames ago, so the server is very likely done
+     * with it. If not, block on its completion event rather than a full XSync
+     * round trip.
+     */
+    if (p_image->is_pending) {
+      p_window->num_completion_waits++;
+      if ((p_window->num_completion_waits % 1000) == 1) {
+        log_do_log(k_log_video,
+                   k_log_info,
+                   "waited for X server to finish a frame (%"PRIu64" times)",
+                   p_window->num_completion_waits);
+      }
+    }
+    while (p_image->is_pending) {
+      XEvent event;
+      ret = XNextEvent(p_window->d, &event);
+      if (ret != 0) {
+        errx(1, "XNextEvent failed");
+      }
+      os_window_handle_event(p_window, &event);
+    }
+
+    (void) memcpy(p_image->p_image_data, p_window->p_buffer, size);
+
+    bool_ret = XShmPutImage(p_window->d,
+                            p_window->w,
+                            p_window->gc,
+                            p_image->p_image,
+                            0,
+                            0,
+                            0,
+                            0,
+                            p_window->width,
+                            p_window->height,
+                            True);
     if (bool_ret != True) {
       errx(1, "XShmPutImage failed");
     }
+    p_image->is_pending = 1;
+    p_window->image_index = ((p_window->image_index + 1) %
+                             k_os_window_num_images);
   } else {
     /* The return value of XPutImage doesn't actually seem to be useful. */
     (void) XPutImage(p_window->d,
                      p_window->w,
                      p_window->gc,
-                     p_window->p_image,
+                     p_image->p_image,
                      0,
                      0,
                      0,
@@ -428,13 +600,9 @@ os_window_sync_buffer_to_screen(struct os_window_struct* p_window) {
                      p_window->height);
   }
 
-  /* We need to sync here so that the server ack's it has finished the
-   * XShmPutImage. Clients of this function expect to be able to start writing
-   * to the buffer again immediately without affecting display.
-   */
-  ret = XSync(p_window->d, False);
+  ret = XFlush(p_window->d);
   if (ret != 1) {
-    errx(1, "XSync failed");
+    errx(1, "XFlush failed");
   }
     
   /* We need to check for X events here, in case a key event comes
@@ -446,76 +614,6 @@ os_window_sync_buffer_to_screen(struct os_window_struct* p_window) {
   os_window_process_events(p_window);
 }
 
-static uint8_t
-os_window_convert_key_code(struct os_window_struct* p_window,
-                           uint32_t keycode) {
-  uint8_t* p_key_map = p_window->p_key_map;
-  uint8_t key = 0;
-
-  if (keycode < 256) {
-    key = p_key_map[keycode];
-  }
-
-  return key;
-}
-
-void
-os_window_process_events(struct os_window_struct* p_window) {
-  Display* d = p_window->d;
-  struct keyboard_struct* p_keyboard = p_window->p_keyboard;
-
-  while (XPending(d) > 0) {
-    XEvent event;
-    int keycode;
-    int key;
-
-    int ret = XNextEvent(d, &event);
-    if (ret != 0) {
-      errx(1, "XNextEvent failed");
-    }
-
-    switch (event.type) {
-    case KeyPress:
-      keycode = event.xkey.keycode;
-      key = os_window_convert_key_code(p_window, keycode);
-      if (key != 0) {
-        keyboard_system_key_pressed(p_keyboard, key);
-      } else {
-        log_do_log(k_log_keyboard,
-                   k_log_unimplemented,
-                   "unmapped key press %d",
-                   keycode);
-      }
-      break;
-    case KeyRelease:
-      keycode = event.xkey.keycode;
-      key = os_window_convert_key_code(p_window, keycode);
-      if (key != 0) {
-        keyboard_system_key_released(p_keyboard, key);
-      } else {
-        log_do_log(k_log_keyboard,
-                   k_log_unimplemented,
-                   "unmapped key release %d",
-                   keycode);
-      }
-      break;
-    case ClientMessage:
-      if ((Atom) event.xclient.data.l[0] == p_window->atom_delete_message) {
-        p_window->is_deleted = 1;
-      }
-      break;
-    case FocusOut:
-      if (p_window->p_focus_lost_callback) {
-        p_window->p_focus_lost_callback(p_window->p_focus_lost_callback_object);
-      }
-      break;
-    default:
-      /* Various events cannot be masked, so we just ignore them. */
-      break;
-    }
-  }
-}
-
 int
 os_window_is_closed(struct os_window_struct* p_window) {
   return p_window->is_deleted;
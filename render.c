@@ -1,12 +1,51 @@
 #include "render.h"
 
 #include "bbc_options.h"
+#include "os_channel.h"
+#include "os_thread.h"
 #include "teletext.h"
 #include "util.h"
 
 #include <assert.h>
 #include <string.h>
 
+enum {
+  /* Must be a power of 2. A 2MHz frame is about 40k characters. */
+  k_render_queue_size = 65536,
+};
+
+enum {
+  /* Palettes remembered per mode, so that raster palette effects which cycle
+   * through a few palettes per frame don't regenerate tables.
+   */
+  k_render_table_cache_size = 4,
+  /* Pixel layouts: 8, 4 or 2 pixels per character. */
+  k_render_num_layouts = 3,
+};
+
+enum {
+  k_render_cmd_data = 0,
+  k_render_cmd_blank = 1,
+  k_render_cmd_hsync = 2,
+  k_render_cmd_cursor = 3,
+  k_render_cmd_frame_boundary = 4,
+  k_render_cmd_set_RA = 5,
+  k_render_cmd_set_mode = 6,
+  k_render_cmd_set_palette = 7,
+  k_render_cmd_set_cursor_segments = 8,
+  k_render_cmd_teletext_RA = 9,
+  k_render_cmd_teletext_DISPMTG = 10,
+  k_render_cmd_teletext_VSYNC = 11,
+};
+
+struct render_table_slot {
+  /* A render_table_1MHz or render_table_2MHz, allocated on first use. */
+  uint32_t* p_pixels;
+  uint32_t palette[16];
+  int is_valid;
+  uint32_t last_used;
+};
+
 struct render_struct {
   void (*p_flyback_callback)(void*);
   void* p_flyback_callback_object;
@@ -20,14 +59,24 @@ struct render_struct {
 
   struct teletext_struct* p_teletext;
 
+  /* Pixel values for the chosen format, for the fixed colors. */
+  int pixel_format;
+  uint32_t pixel_black;
+  uint32_t pixel_red;
+  uint32_t pixel_cursor_xor;
+
   uint32_t palette[16];
   int render_table_dirty[k_render_num_modes];
-  struct render_table_2MHz render_table_mode0;
-  struct render_table_2MHz render_table_mode1;
-  struct render_table_2MHz render_table_mode2;
-  struct render_table_1MHz render_table_mode4;
-  struct render_table_1MHz render_table_mode5;
-  struct render_table_1MHz render_table_mode8;
+  struct render_table_slot
+      render_table_slots[k_render_num_modes][k_render_table_cache_size];
+  uint32_t render_table_current[k_render_num_modes];
+  uint32_t render_table_use_count;
+  /* For each pixel layout, the (character << 3 | pixel) entries that display
+   * each palette index, indexed by palette_index_starts. This is what lets a
+   * palette write rewrite only the affected parts of a table.
+   */
+  uint16_t palette_index_entries[k_render_num_layouts][256 * 8];
+  uint16_t palette_index_starts[k_render_num_layouts][17];
 
   struct render_character_1MHz render_character_1MHz_black;
   struct render_character_2MHz render_character_2MHz_black;
@@ -56,6 +105,28 @@ struct render_struct {
   int32_t cursor_segment_index;
   int cursor_segments[4];
   int is_double_size;
+
+  /* Render thread. The CPU thread queues commands, one 32-bit word each,
+   * command in the top byte. The worker thread replays them, producing
+   * pixels. Only the CPU thread writes queue_head and only the worker thread
+   * writes queue_tail. Anything that isn't queued waits for the worker to go
+   * idle first; see render_drain().
+   */
+  int is_threaded;
+  struct os_thread_struct* p_worker_thread;
+  intptr_t handle_worker_read;
+  intptr_t handle_cpu_write;
+  intptr_t handle_cpu_read;
+  intptr_t handle_worker_write;
+  uint32_t* p_queue;
+  uint32_t queue_head;
+  uint32_t queue_head_unpublished;
+  uint32_t queue_tail;
+  uint32_t queue_tail_cached;
+  int is_worker_sleeping;
+  int is_cpu_waiting;
+  int is_flyback_pending;
+  int do_exit;
 };
 
 static void
@@ -66,6 +137,73 @@ render_dirty_all_tables(struct render_struct* p_render) {
   }
 }
 
+static uint32_t
+render_get_pixel_value(struct render_struct* p_render, uint8_t color) {
+  uint32_t pixel;
+
+  assert(color < 8);
+
+  if (p_render->pixel_format == k_render_pixel_format_index) {
+    return color;
+  }
+
+  pixel = 0xff000000;
+  if (color & 0x1) {
+    pixel |= 0x00ff0000;
+  }
+  if (color & 0x2) {
+    pixel |= 0x0000ff00;
+  }
+  if (color & 0x4) {
+    pixel |= 0x000000ff;
+  }
+  return pixel;
+}
+
+static uint32_t
+render_get_palette_index(uint8_t shift_register) {
+  return (((shift_register & 0x02) >> 1) |
+          ((shift_register & 0x08) >> 2) |
+          ((shift_register & 0x20) >> 3) |
+          ((shift_register & 0x80) >> 4));
+}
+
+static void
+render_build_palette_index_entries(struct render_struct* p_render) {
+  uint32_t layout;
+  uint32_t i;
+  uint32_t j;
+
+  for (layout = 0; layout < k_render_num_layouts; ++layout) {
+    uint32_t counts[16];
+    uint32_t num_pixels = (8 >> layout);
+    uint16_t* p_entries = &p_render->palette_index_entries[layout][0];
+    uint16_t* p_starts = &p_render->palette_index_starts[layout][0];
+
+    (void) memset(counts, '\0', sizeof(counts));
+    for (i = 0; i < 256; ++i) {
+      uint8_t shift_register = i;
+      for (j = 0; j < num_pixels; ++j) {
+        counts[render_get_palette_index(shift_register)]++;
+        shift_register = ((shift_register << 1) | 1);
+      }
+    }
+    p_starts[0] = 0;
+    for (i = 0; i < 16; ++i) {
+      p_starts[i + 1] = (p_starts[i] + counts[i]);
+      counts[i] = p_starts[i];
+    }
+    for (i = 0; i < 256; ++i) {
+      uint8_t shift_register = i;
+      for (j = 0; j < num_pixels; ++j) {
+        uint32_t index = render_get_palette_index(shift_register);
+        p_entries[counts[index]++] = ((i << 3) | j);
+        shift_register = ((shift_register << 1) | 1);
+      }
+    }
+  }
+}
+
 struct render_struct*
 render_create(struct teletext_struct* p_teletext,
               struct bbc_options* p_options) {
@@ -87,11 +225,35 @@ render_create(struct teletext_struct* p_teletext,
   uint32_t k_vert_standard_offset = 4;
 
   const char* p_opt_flags = p_options->p_opt_flags;
+  char* p_pixel_format = NULL;
 
   struct render_struct* p_render = util_mallocz(sizeof(struct render_struct));
 
   p_render->p_teletext = p_teletext;
 
+  /* Pixels are 32-bit BGRA by default. The alternative is the 3-bit physical
+   * color (the host doesn't see a palette), which is exact and compact for
+   * capturing frames; teletext loses its character smoothing.
+   */
+  p_render->pixel_format = k_render_pixel_format_bgra;
+  (void) util_get_str_option(&p_pixel_format,
+                             p_opt_flags,
+                             "video:pixel-format=");
+  if (p_pixel_format != NULL) {
+    if (!strcmp(p_pixel_format, "index")) {
+      p_render->pixel_format = k_render_pixel_format_index;
+    } else if (strcmp(p_pixel_format, "bgra")) {
+      util_bail("unknown pixel format: %s", p_pixel_format);
+    }
+    util_free(p_pixel_format);
+  }
+  p_render->pixel_black = render_get_pixel_value(p_render, 0);
+  p_render->pixel_red = render_get_pixel_value(p_render, 1);
+  p_render->pixel_cursor_xor = (render_get_pixel_value(p_render, 7) ^
+                                p_render->pixel_black);
+  teletext_set_is_indexed(
+      p_teletext, (p_render->pixel_format == k_render_pixel_format_index));
+
   /* "border characters" is the number of MODE1 square 8x8 pixel characters
    * used to pad the display window beyond the standard viewport for MODE1.
    * If set to zero, standard modes will fit perfectly. If set larger than
@@ -114,6 +276,19 @@ render_create(struct teletext_struct* p_teletext,
   p_render->do_show_frame_boundaries = util_has_option(
       p_opt_flags, "video:frame-boundaries");
 
+  /* Only the accurate CRTC renders incrementally from the CPU thread. The
+   * full frame render is on the UI thread and is left alone.
+   */
+  if (p_options->accurate &&
+      util_has_option(p_opt_flags, "video:render-thread")) {
+    p_render->is_threaded = 1;
+    p_render->p_queue = util_malloc(k_render_queue_size * sizeof(uint32_t));
+    os_channel_get_handles(&p_render->handle_worker_read,
+                           &p_render->handle_cpu_write,
+                           &p_render->handle_cpu_read,
+                           &p_render->handle_worker_write);
+  }
+
   width = (640 + (border_chars * 2 * 16));
   height = (512 + (border_chars * 2 * 16));
 
@@ -154,12 +329,15 @@ render_create(struct teletext_struct* p_teletext,
   p_render->cursor_segment_index = -1;
 
   render_dirty_all_tables(p_render);
+  render_build_palette_index_entries(p_render);
 
   for (i = 0; i < 16; ++i) {
-    p_render->render_character_1MHz_black.host_pixels[i] = 0xff000000;
+    p_render->render_character_1MHz_black.host_pixels[i] =
+        p_render->pixel_black;
   }
   for (i = 0; i < 8; ++i) {
-    p_render->render_character_2MHz_black.host_pixels[i] = 0xff000000;
+    p_render->render_character_2MHz_black.host_pixels[i] =
+        p_render->pixel_black;
   }
   for (i = 0; i < 256; ++i) {
     p_render->render_table_1MHz_black.values[i] =
@@ -173,9 +351,31 @@ render_create(struct teletext_struct* p_teletext,
 
 void
 render_destroy(struct render_struct* p_render) {
+  uint32_t i;
+  uint32_t j;
+
+  if (p_render->p_worker_thread != NULL) {
+    /* The worker picks this up next time it runs out of work. */
+    uint8_t message = 0;
+    __atomic_store_n(&p_render->do_exit, 1, __ATOMIC_SEQ_CST);
+    os_channel_write(p_render->handle_cpu_write, &message, 1);
+    (void) os_thread_destroy(p_render->p_worker_thread);
+  }
+  if (p_render->is_threaded) {
+    os_channel_free_handles(p_render->handle_worker_read,
+                            p_render->handle_cpu_write,
+                            p_render->handle_cpu_read,
+                            p_render->handle_worker_write);
+    util_free(p_render->p_queue);
+  }
   if (p_render->is_buffer_owned) {
     util_free(p_render->p_buffer);
   }
+  for (i = 0; i < k_render_num_modes; ++i) {
+    for (j = 0; j < k_render_table_cache_size; ++j) {
+      util_free(p_render->render_table_slots[i][j].p_pixels);
+    }
+  }
   util_free(p_render);
 }
 
@@ -187,6 +387,11 @@ render_set_flyback_callback(struct render_struct* p_render,
   p_render->p_flyback_callback_object = p_flyback_callback_object;
 }
 
+int
+render_get_pixel_format(struct render_struct* p_render) {
+  return p_render->pixel_format;
+}
+
 uint32_t
 render_get_width(struct render_struct* p_render) {
   return p_render->width;
@@ -310,10 +515,11 @@ render_check_cursor(struct render_struct* p_render,
   if (p_render->cursor_segments[p_render->cursor_segment_index] &&
       (p_render_pos >= p_render->p_render_pos_row)) {
     uint32_t i;
+    uint32_t cursor_xor = p_render->pixel_cursor_xor;
     for (i = 0; i < num_pixels; ++i) {
-      p_render_pos[i] ^= 0x00ffffff;
+      p_render_pos[i] ^= cursor_xor;
       if (p_next_render_pos != NULL) {
-        p_next_render_pos[i] ^= 0x00ffffff;
+        p_next_render_pos[i] ^= cursor_xor;
       }
     }
   }
@@ -580,16 +786,14 @@ render_function_2MHz_blank_interlaced(struct render_struct* p_render,
   }
 }
 
-void
-render_set_mode(struct render_struct* p_render, int mode) {
+static void
+render_do_set_mode(struct render_struct* p_render, int mode) {
   assert((mode >= k_render_mode0) && (mode <= k_render_mode8));
 
   if (mode == p_render->render_mode) {
     return;
   }
 
-  render_dirty_all_tables(p_render);
-
   switch (mode) {
   case k_render_mode0:
   case k_render_mode1:
@@ -617,24 +821,26 @@ render_set_mode(struct render_struct* p_render, int mode) {
   render_reset_render_pos(p_render);
 }
 
-void
-render_set_palette(struct render_struct* p_render,
-                   uint8_t index,
-                   uint32_t rgba) {
-  if (p_render->palette[index] == rgba) {
+static void
+render_do_set_palette(struct render_struct* p_render,
+                      uint8_t index,
+                      uint8_t color) {
+  uint32_t pixel = render_get_pixel_value(p_render, color);
+
+  if (p_render->palette[index] == pixel) {
     return;
   }
 
-  p_render->palette[index] = rgba;
+  p_render->palette[index] = pixel;
   render_dirty_all_tables(p_render);
 }
 
-void
-render_set_cursor_segments(struct render_struct* p_render,
-                           int s0,
-                           int s1,
-                           int s2,
-                           int s3) {
+static void
+render_do_set_cursor_segments(struct render_struct* p_render,
+                              int s0,
+                              int s1,
+                              int s2,
+                              int s3) {
   p_render->cursor_segments[0] = s0;
   p_render->cursor_segments[1] = s1;
   p_render->cursor_segments[2] = s2;
@@ -642,184 +848,181 @@ render_set_cursor_segments(struct render_struct* p_render,
 }
 
 static void
-render_generate_1MHz_table(struct render_struct* p_render,
-                           struct render_table_1MHz* p_table,
-                           uint32_t num_pixels) {
+render_get_table_layout(uint32_t* p_char_pixels,
+                        uint32_t* p_layout,
+                        int mode) {
+  switch (mode) {
+  case k_render_mode0:
+    *p_char_pixels = 8;
+    *p_layout = 0;
+    break;
+  case k_render_mode1:
+    *p_char_pixels = 8;
+    *p_layout = 1;
+    break;
+  case k_render_mode2:
+    *p_char_pixels = 8;
+    *p_layout = 2;
+    break;
+  case k_render_mode4:
+    *p_char_pixels = 16;
+    *p_layout = 0;
+    break;
+  case k_render_mode5:
+    *p_char_pixels = 16;
+    *p_layout = 1;
+    break;
+  case k_render_mode8:
+    *p_char_pixels = 16;
+    *p_layout = 2;
+    break;
+  default:
+    assert(0);
+    break;
+  }
+}
+
+static void
+render_generate_table(struct render_struct* p_render,
+                      uint32_t* p_pixels,
+                      uint32_t char_pixels,
+                      uint32_t layout) {
   uint32_t i;
   uint32_t j;
 
-  uint32_t pixel_stride = (16 / num_pixels);
-  uint32_t palette_index = 0;
+  uint32_t pixel_stride = ((char_pixels / 8) << layout);
   uint32_t pixel_value = 0;
 
   for (i = 0; i < 256; ++i) {
-    struct render_character_1MHz* p_character = &p_table->values[i];
     uint8_t shift_register = i;
-    for (j = 0; j < 16; ++j) {
+    for (j = 0; j < char_pixels; ++j) {
       if ((j % pixel_stride) == 0) {
-        palette_index = (((shift_register & 0x02) >> 1) |
-                         ((shift_register & 0x08) >> 2) |
-                         ((shift_register & 0x20) >> 3) |
-                         ((shift_register & 0x80) >> 4));
-        pixel_value = p_render->palette[palette_index];
+        pixel_value = p_render->palette[render_get_palette_index(
+            shift_register)];
         shift_register <<= 1;
         shift_register |= 1;
       }
-      p_character->host_pixels[j] = pixel_value;
+      *p_pixels++ = pixel_value;
     }
   }
 }
 
 static void
-render_generate_2MHz_table(struct render_struct* p_render,
-                           struct render_table_2MHz* p_table,
-                           uint32_t num_pixels) {
+render_update_table_for_index(struct render_struct* p_render,
+                              uint32_t* p_pixels,
+                              uint32_t char_pixels,
+                              uint32_t layout,
+                              uint32_t index) {
   uint32_t i;
   uint32_t j;
 
-  uint32_t pixel_stride = (8 / num_pixels);
-  uint32_t palette_index = 0;
-  uint32_t pixel_value = 0;
-
-  for (i = 0; i < 256; ++i) {
-    struct render_character_2MHz* p_character = &p_table->values[i];
-    uint8_t shift_register = i;
-    for (j = 0; j < 8; ++j) {
-      if ((j % pixel_stride) == 0) {
-        palette_index = (((shift_register & 0x02) >> 1) |
-                         ((shift_register & 0x08) >> 2) |
-                         ((shift_register & 0x20) >> 3) |
-                         ((shift_register & 0x80) >> 4));
-        pixel_value = p_render->palette[palette_index];
-        shift_register <<= 1;
-        shift_register |= 1;
-      }
-      p_character->host_pixels[j] = pixel_value;
+  uint32_t pixel_stride = ((char_pixels / 8) << layout);
+  uint32_t pixel_value = p_render->palette[index];
+  uint16_t* p_entries = &p_render->palette_index_entries[layout][0];
+  uint32_t start = p_render->palette_index_starts[layout][index];
+  uint32_t end = p_render->palette_index_starts[layout][index + 1];
+
+  for (i = start; i < end; ++i) {
+    uint32_t entry = p_entries[i];
+    uint32_t* p_dest = (p_pixels +
+                        ((entry >> 3) * char_pixels) +
+                        ((entry & 7) * pixel_stride));
+    for (j = 0; j < pixel_stride; ++j) {
+      p_dest[j] = pixel_value;
     }
   }
 }
 
-static void
-render_generate_mode0_table(struct render_struct* p_render) {
-  render_generate_2MHz_table(p_render, &p_render->render_table_mode0, 8);
-}
+static uint32_t*
+render_get_mode_table(struct render_struct* p_render, int mode) {
+  uint32_t i;
+  uint32_t char_pixels;
+  uint32_t layout;
+  struct render_table_slot* p_slot;
 
-static void
-render_generate_mode1_table(struct render_struct* p_render) {
-  render_generate_2MHz_table(p_render, &p_render->render_table_mode1, 4);
-}
+  struct render_table_slot* p_slots = &p_render->render_table_slots[mode][0];
 
-static void
-render_generate_mode2_table(struct render_struct* p_render) {
-  render_generate_2MHz_table(p_render, &p_render->render_table_mode2, 2);
-}
+  if (!p_render->render_table_dirty[mode]) {
+    return p_slots[p_render->render_table_current[mode]].p_pixels;
+  }
+  p_render->render_table_dirty[mode] = 0;
+  p_render->render_table_use_count++;
+
+  /* A palette we've had recently is free. */
+  for (i = 0; i < k_render_table_cache_size; ++i) {
+    p_slot = &p_slots[i];
+    if (p_slot->is_valid &&
+        !memcmp(p_slot->palette, p_render->palette, sizeof(p_slot->palette))) {
+      p_slot->last_used = p_render->render_table_use_count;
+      p_render->render_table_current[mode] = i;
+      return p_slot->p_pixels;
+    }
+  }
 
-static void
-render_generate_mode4_table(struct render_struct* p_render) {
-  render_generate_1MHz_table(p_render, &p_render->render_table_mode4, 8);
-}
+  /* Otherwise, recycle the least recently used table, rewriting only the
+   * pixels for palette entries that differ. A raster effect typically
+   * changes one or two entries.
+   */
+  p_slot = &p_slots[0];
+  for (i = 0; i < k_render_table_cache_size; ++i) {
+    if (!p_slots[i].is_valid) {
+      p_slot = &p_slots[i];
+      break;
+    }
+    if (p_slots[i].last_used < p_slot->last_used) {
+      p_slot = &p_slots[i];
+    }
+  }
 
-static void
-render_generate_mode5_table(struct render_struct* p_render) {
-  render_generate_1MHz_table(p_render, &p_render->render_table_mode5, 4);
-}
+  render_get_table_layout(&char_pixels, &layout, mode);
+  if (!p_slot->is_valid) {
+    if (p_slot->p_pixels == NULL) {
+      p_slot->p_pixels = util_malloc(256 * char_pixels * sizeof(uint32_t));
+    }
+    render_generate_table(p_render, p_slot->p_pixels, char_pixels, layout);
+  } else {
+    for (i = 0; i < 16; ++i) {
+      if (p_slot->palette[i] != p_render->palette[i]) {
+        render_update_table_for_index(p_render,
+                                      p_slot->p_pixels,
+                                      char_pixels,
+                                      layout,
+                                      i);
+      }
+    }
+  }
 
-static void
-render_generate_mode8_table(struct render_struct* p_render) {
-  render_generate_1MHz_table(p_render, &p_render->render_table_mode8, 2);
+  (void) memcpy(p_slot->palette, p_render->palette, sizeof(p_slot->palette));
+  p_slot->is_valid = 1;
+  p_slot->last_used = p_render->render_table_use_count;
+  p_render->render_table_current[mode] = (p_slot - p_slots);
+
+  return p_slot->p_pixels;
 }
 
 static void
 render_check_2MHz_render_table(struct render_struct* p_render) {
-  int mode;
-
   if (p_render->is_rendering_black) {
     p_render->p_render_table_2MHz = &p_render->render_table_2MHz_black;
     return;
   }
 
-  mode = p_render->render_mode;
-
-  if (p_render->render_table_dirty[mode]) {
-    switch (mode) {
-    case k_render_mode0:
-      render_generate_mode0_table(p_render);
-      break;
-    case k_render_mode1:
-      render_generate_mode1_table(p_render);
-      break;
-    case k_render_mode2:
-      render_generate_mode2_table(p_render);
-      break;
-    default:
-      assert(0);
-      break;
-    }
-    p_render->render_table_dirty[mode] = 0;
-  }
-
-  switch (mode) {
-  case k_render_mode0:
-    p_render->p_render_table_2MHz = &p_render->render_table_mode0;
-    break;
-  case k_render_mode1:
-    p_render->p_render_table_2MHz = &p_render->render_table_mode1;
-    break;
-  case k_render_mode2:
-    p_render->p_render_table_2MHz = &p_render->render_table_mode2;
-    break;
-  default:
-    assert(0);
-    break;
-  }
+  p_render->p_render_table_2MHz = (struct render_table_2MHz*)
+      render_get_mode_table(p_render, p_render->render_mode);
 }
 
 static void
 render_check_1MHz_render_table(struct render_struct* p_render) {
-  int mode;
-
   if (p_render->is_rendering_black) {
     p_render->p_render_table_1MHz = &p_render->render_table_1MHz_black;
     return;
   }
 
-  mode = p_render->render_mode;
-
-  if (p_render->render_table_dirty[mode]) {
-    switch (mode) {
-    case k_render_mode4:
-      render_generate_mode4_table(p_render);
-      break;
-    case k_render_mode5:
-      render_generate_mode5_table(p_render);
-      break;
-    case k_render_mode8:
-      render_generate_mode8_table(p_render);
-      break;
-    default:
-      assert(0);
-      break;
-    }
-    p_render->render_table_dirty[mode] = 0;
-  }
-
-  switch (mode) {
-  case k_render_mode4:
-    p_render->p_render_table_1MHz = &p_render->render_table_mode4;
-    break;
-  case k_render_mode5:
-    p_render->p_render_table_1MHz = &p_render->render_table_mode5;
-    break;
-  case k_render_mode8:
-    p_render->p_render_table_1MHz = &p_render->render_table_mode8;
-    break;
-  default:
-    assert(0);
-    break;
-  }
+  p_render->p_render_table_1MHz = (struct render_table_1MHz*)
+      render_get_mode_table(p_render, p_render->render_mode);
 }
 
-void (*render_get_render_data_function(struct render_struct* p_render))
+static void (*render_get_direct_data_function(struct render_struct* p_render))
     (struct render_struct*, uint8_t) {
   if (p_render->render_mode == k_render_mode7) {
     if (p_render->do_deinterlace_teletext) {
@@ -844,8 +1047,8 @@ void (*render_get_render_data_function(struct render_struct* p_render))
   }
 }
 
-void (*render_get_render_blank_function(struct render_struct* p_render))
-    (struct render_struct*, uint8_t) {
+static void (*render_get_direct_blank_function(
+    struct render_struct* p_render))(struct render_struct*, uint8_t) {
   if (p_render->render_mode == k_render_mode7) {
     if (p_render->do_deinterlace_teletext) {
       return render_function_1MHz_blank_deinterlaced;
@@ -867,8 +1070,8 @@ void (*render_get_render_blank_function(struct render_struct* p_render))
   }
 }
 
-void
-render_set_RA(struct render_struct* p_render, uint32_t row_address) {
+static void
+render_do_set_RA(struct render_struct* p_render, uint32_t row_address) {
   int is_rendering_black = 0;
   int old_is_rendering_black = p_render->is_rendering_black;
 
@@ -895,8 +1098,9 @@ render_clear_buffer(struct render_struct* p_render) {
   uint32_t i;
   uint32_t size = (render_get_buffer_size(p_render) / 4);
   uint32_t* p_buf = p_render->p_buffer;
+  uint32_t pixel_black = p_render->pixel_black;
   for (i = 0; i < size; ++i) {
-    p_buf[i] = 0xff000000;
+    p_buf[i] = pixel_black;
   }
 }
 
@@ -941,8 +1145,19 @@ render_process_full_buffer(struct render_struct* p_render) {
   }
 }
 
-void
-render_hsync(struct render_struct* p_render, uint32_t hsync_pulse_ticks) {
+static void
+render_do_flyback(struct render_struct* p_render) {
+  p_render->vert_beam_pos = 0;
+
+  if (p_render->horiz_beam_pos >= 512) {
+    /* We're transitioning from the even to the odd interlace frame. */
+    p_render->vert_beam_pos = -1;
+  }
+  render_reset_render_pos(p_render);
+}
+
+static void
+render_do_hsync(struct render_struct* p_render, uint32_t hsync_pulse_ticks) {
   /* A real CRT appears to sync to the middle of the hsync pulse?!! This
    * permits half-character horizontal scrolling.
    * Used by tricky's RallyX demo.
@@ -960,7 +1175,15 @@ render_hsync(struct render_struct* p_render, uint32_t hsync_pulse_ticks) {
    * flyback anyway.
    */
   if (p_render->vert_beam_pos >= 768) {
-    render_vsync(p_render);
+    if (p_render->is_threaded) {
+      /* On the worker thread, so leave the flyback callback to the CPU
+       * thread. See render_flush().
+       */
+      __atomic_store_n(&p_render->is_flyback_pending, 1, __ATOMIC_RELEASE);
+      render_do_flyback(p_render);
+    } else {
+      render_vsync(p_render);
+    }
   }
 
   render_reset_render_pos(p_render);
@@ -974,45 +1197,369 @@ render_hsync(struct render_struct* p_render, uint32_t hsync_pulse_ticks) {
   }
 }
 
-void
-render_vsync(struct render_struct* p_render) {
-  if (p_render->p_flyback_callback) {
-    p_render->p_flyback_callback(p_render->p_flyback_callback_object);
+static void
+render_do_frame_boundary(struct render_struct* p_render) {
+  uint32_t i;
+
+  if (!p_render->do_show_frame_boundaries) {
+    return;
+  }
+  if (p_render->p_render_pos_row == p_render->p_buffer_end) {
+    return;
   }
 
-  p_render->vert_beam_pos = 0;
+  /* Paint a red line to edge of canvas denote CRTC frame boundary. */
+  for (i = 0; i < p_render->width; ++i) {
+    p_render->p_render_pos_row[i] = p_render->pixel_red;
+  }
+}
 
-  if (p_render->horiz_beam_pos >= 512) {
-    /* We're transitioning from the even to the odd interlace frame. */
-    p_render->vert_beam_pos = -1;
+static void
+render_do_cursor(struct render_struct* p_render) {
+  p_render->cursor_segment_index = 0;
+}
+
+static void
+render_do_command(struct render_struct* p_render,
+                  void (**p_func_data)(struct render_struct*, uint8_t),
+                  void (**p_func_blank)(struct render_struct*, uint8_t),
+                  uint32_t command) {
+  uint32_t value = (command & 0xFFFFFF);
+
+  switch (command >> 24) {
+  case k_render_cmd_data:
+    (*p_func_data)(p_render, value);
+    return;
+  case k_render_cmd_blank:
+    (*p_func_blank)(p_render, value);
+    return;
+  case k_render_cmd_hsync:
+    render_do_hsync(p_render, value);
+    return;
+  case k_render_cmd_cursor:
+    render_do_cursor(p_render);
+    return;
+  case k_render_cmd_frame_boundary:
+    render_do_frame_boundary(p_render);
+    return;
+  case k_render_cmd_set_RA:
+    render_do_set_RA(p_render, value);
+    break;
+  case k_render_cmd_set_mode:
+    render_do_set_mode(p_render, value);
+    break;
+  case k_render_cmd_set_palette:
+    render_do_set_palette(p_render, (value >> 8), (value & 0xFF));
+    break;
+  case k_render_cmd_set_cursor_segments:
+    render_do_set_cursor_segments(p_render,
+                                  !!(value & 1),
+                                  !!(value & 2),
+                                  !!(value & 4),
+                                  !!(value & 8));
+    return;
+  case k_render_cmd_teletext_RA:
+    teletext_RA_changed(p_render->p_teletext, value);
+    return;
+  case k_render_cmd_teletext_DISPMTG:
+    teletext_DISPMTG_changed(p_render->p_teletext, value);
+    return;
+  case k_render_cmd_teletext_VSYNC:
+    teletext_VSYNC_changed(p_render->p_teletext, value);
+    return;
+  default:
+    assert(0);
+    return;
   }
-  render_reset_render_pos(p_render);
+
+  /* Mode, palette and RA changes may change the render functions or dirty
+   * their tables.
+   */
+  *p_func_data = render_get_direct_data_function(p_render);
+  *p_func_blank = render_get_direct_blank_function(p_render);
 }
 
-void
-render_frame_boundary(struct render_struct* p_render) {
-  uint32_t i;
+static void*
+render_worker_thread(void* p) {
+  uint8_t message;
+
+  struct render_struct* p_render = (struct render_struct*) p;
+  uint32_t* p_queue = p_render->p_queue;
+  uint32_t tail = p_render->queue_tail;
+
+  while (1) {
+    void (*func_data)(struct render_struct*, uint8_t);
+    void (*func_blank)(struct render_struct*, uint8_t);
+
+    uint32_t head = __atomic_load_n(&p_render->queue_head, __ATOMIC_ACQUIRE);
+
+    if (head == tail) {
+      /* Out of work. Declare that we're going to sleep and check again, so
+       * that either we see new work or the CPU thread sees us sleeping and
+       * sends a wakeup.
+       */
+      __atomic_store_n(&p_render->is_worker_sleeping, 1, __ATOMIC_SEQ_CST);
+      head = __atomic_load_n(&p_render->queue_head, __ATOMIC_SEQ_CST);
+      if ((head == tail) ||
+          !__atomic_exchange_n(&p_render->is_worker_sleeping,
+                               0,
+                               __ATOMIC_SEQ_CST)) {
+        os_channel_read(p_render->handle_worker_read, &message, 1);
+        if (__atomic_load_n(&p_render->do_exit, __ATOMIC_ACQUIRE)) {
+          break;
+        }
+      }
+      continue;
+    }
 
-  if (!p_render->do_show_frame_boundaries) {
+    func_data = render_get_direct_data_function(p_render);
+    func_blank = render_get_direct_blank_function(p_render);
+    while (tail != head) {
+      uint32_t command = p_queue[tail & (k_render_queue_size - 1)];
+      tail++;
+      render_do_command(p_render, &func_data, &func_blank, command);
+    }
+
+    __atomic_store_n(&p_render->queue_tail, tail, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&p_render->is_cpu_waiting, __ATOMIC_SEQ_CST) &&
+        (__atomic_load_n(&p_render->queue_head, __ATOMIC_SEQ_CST) == tail) &&
+        __atomic_exchange_n(&p_render->is_cpu_waiting, 0, __ATOMIC_SEQ_CST)) {
+      os_channel_write(p_render->handle_worker_write, &message, 1);
+    }
+  }
+
+  return NULL;
+}
+
+static void
+render_publish(struct render_struct* p_render) {
+  uint8_t message = 0;
+
+  if (p_render->p_worker_thread == NULL) {
+    p_render->p_worker_thread = os_thread_create(render_worker_thread,
+                                                 p_render);
+  }
+
+  __atomic_store_n(&p_render->queue_head,
+                   p_render->queue_head_unpublished,
+                   __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&p_render->is_worker_sleeping, __ATOMIC_SEQ_CST) &&
+      __atomic_exchange_n(&p_render->is_worker_sleeping,
+                          0,
+                          __ATOMIC_SEQ_CST)) {
+    os_channel_write(p_render->handle_cpu_write, &message, 1);
+  }
+}
+
+static void
+render_drain(struct render_struct* p_render) {
+  /* Publish everything and wait for the worker to finish it. After this, the
+   * CPU thread may touch render state directly until it next publishes.
+   */
+  uint8_t message;
+
+  uint32_t head = p_render->queue_head_unpublished;
+
+  if (!p_render->is_threaded) {
     return;
   }
-  if (p_render->p_render_pos_row == p_render->p_buffer_end) {
+
+  p_render->queue_tail_cached = head;
+  if (__atomic_load_n(&p_render->queue_tail, __ATOMIC_ACQUIRE) == head) {
     return;
   }
 
-  /* Paint a red line to edge of canvas denote CRTC frame boundary. */
-  for (i = 0; i < p_render->width; ++i) {
-    p_render->p_render_pos_row[i] = 0xffff0000;
+  render_publish(p_render);
+  __atomic_store_n(&p_render->is_cpu_waiting, 1, __ATOMIC_SEQ_CST);
+  if ((__atomic_load_n(&p_render->queue_tail, __ATOMIC_SEQ_CST) == head) &&
+      __atomic_exchange_n(&p_render->is_cpu_waiting, 0, __ATOMIC_SEQ_CST)) {
+    return;
+  }
+  os_channel_read(p_render->handle_cpu_read, &message, 1);
+}
+
+static inline void
+render_queue_put(struct render_struct* p_render, uint32_t command) {
+  uint32_t head = p_render->queue_head_unpublished;
+
+  if ((head - p_render->queue_tail_cached) == k_render_queue_size) {
+    p_render->queue_tail_cached = __atomic_load_n(&p_render->queue_tail,
+                                                  __ATOMIC_ACQUIRE);
+    if ((head - p_render->queue_tail_cached) == k_render_queue_size) {
+      render_drain(p_render);
+    }
+  }
+
+  p_render->p_queue[head & (k_render_queue_size - 1)] = command;
+  p_render->queue_head_unpublished = (head + 1);
+}
+
+static void
+render_function_queue_data(struct render_struct* p_render, uint8_t data) {
+  render_queue_put(p_render, ((k_render_cmd_data << 24) | data));
+}
+
+static void
+render_function_queue_blank(struct render_struct* p_render, uint8_t data) {
+  render_queue_put(p_render, ((k_render_cmd_blank << 24) | data));
+}
+
+void
+render_set_mode(struct render_struct* p_render, int mode) {
+  if (p_render->is_threaded) {
+    render_queue_put(p_render, ((k_render_cmd_set_mode << 24) | mode));
+  } else {
+    render_do_set_mode(p_render, mode);
+  }
+}
+
+void
+render_set_palette(struct render_struct* p_render,
+                   uint8_t index,
+                   uint8_t color) {
+  if (p_render->is_threaded) {
+    render_queue_put(p_render,
+                     ((k_render_cmd_set_palette << 24) | (index << 8) | color));
+  } else {
+    render_do_set_palette(p_render, index, color);
+  }
+}
+
+void
+render_set_cursor_segments(struct render_struct* p_render,
+                           int s0,
+                           int s1,
+                           int s2,
+                           int s3) {
+  if (p_render->is_threaded) {
+    uint32_t segments = ((!!s0) | (!!s1 << 1) | (!!s2 << 2) | (!!s3 << 3));
+    render_queue_put(p_render,
+                     ((k_render_cmd_set_cursor_segments << 24) | segments));
+  } else {
+    render_do_set_cursor_segments(p_render, s0, s1, s2, s3);
+  }
+}
+
+void
+render_set_RA(struct render_struct* p_render, uint32_t row_address) {
+  if (p_render->is_threaded) {
+    render_queue_put(p_render, ((k_render_cmd_set_RA << 24) | row_address));
+  } else {
+    render_do_set_RA(p_render, row_address);
+  }
+}
+
+void (*render_get_render_data_function(struct render_struct* p_render))
+    (struct render_struct*, uint8_t) {
+  if (p_render->is_threaded) {
+    return render_function_queue_data;
+  }
+  return render_get_direct_data_function(p_render);
+}
+
+void (*render_get_render_blank_function(struct render_struct* p_render))
+    (struct render_struct*, uint8_t) {
+  if (p_render->is_threaded) {
+    return render_function_queue_blank;
+  }
+  return render_get_direct_blank_function(p_render);
+}
+
+void
+render_hsync(struct render_struct* p_render, uint32_t hsync_pulse_ticks) {
+  if (p_render->is_threaded) {
+    render_queue_put(p_render,
+                     ((k_render_cmd_hsync << 24) | hsync_pulse_ticks));
+  } else {
+    render_do_hsync(p_render, hsync_pulse_ticks);
+  }
+}
+
+void
+render_vsync(struct render_struct* p_render) {
+  /* The flyback callback paints, so the frame must be complete. */
+  render_drain(p_render);
+
+  if (p_render->p_flyback_callback) {
+    p_render->p_flyback_callback(p_render->p_flyback_callback_object);
+  }
+
+  render_do_flyback(p_render);
+}
+
+void
+render_frame_boundary(struct render_struct* p_render) {
+  if (p_render->is_threaded) {
+    render_queue_put(p_render, (k_render_cmd_frame_boundary << 24));
+  } else {
+    render_do_frame_boundary(p_render);
   }
 }
 
 void
 render_cursor(struct render_struct* p_render) {
-  p_render->cursor_segment_index = 0;
+  if (p_render->is_threaded) {
+    render_queue_put(p_render, (k_render_cmd_cursor << 24));
+  } else {
+    render_do_cursor(p_render);
+  }
 }
 
 void
 render_set_horiz_beam_pos(struct render_struct* p_render, uint32_t pos) {
+  render_drain(p_render);
+
   p_render->horiz_beam_pos = pos;
   render_reset_render_pos(p_render);
 }
+
+void
+render_teletext_RA_changed(struct render_struct* p_render, uint8_t ra) {
+  if (p_render->is_threaded) {
+    render_queue_put(p_render, ((k_render_cmd_teletext_RA << 24) | ra));
+  } else {
+    teletext_RA_changed(p_render->p_teletext, ra);
+  }
+}
+
+void
+render_teletext_DISPMTG_changed(struct render_struct* p_render, int value) {
+  if (p_render->is_threaded) {
+    render_queue_put(p_render,
+                     ((k_render_cmd_teletext_DISPMTG << 24) | !!value));
+  } else {
+    teletext_DISPMTG_changed(p_render->p_teletext, value);
+  }
+}
+
+void
+render_teletext_VSYNC_changed(struct render_struct* p_render, int value) {
+  if (p_render->is_threaded) {
+    render_queue_put(p_render,
+                     ((k_render_cmd_teletext_VSYNC << 24) | !!value));
+  } else {
+    teletext_VSYNC_changed(p_render->p_teletext, value);
+  }
+}
+
+void
+render_flush(struct render_struct* p_render) {
+  if (!p_render->is_threaded) {
+    return;
+  }
+
+  if (p_render->queue_head_unpublished !=
+      __atomic_load_n(&p_render->queue_head, __ATOMIC_RELAXED)) {
+    render_publish(p_render);
+  }
+
+  /* A flyback the worker hit without a vsync, i.e. the beam ran off the
+   * bottom. It's painted late and the worker may already be drawing the next
+   * frame, but this only happens with broken CRTC setups.
+   */
+  if (__atomic_load_n(&p_render->is_flyback_pending, __ATOMIC_ACQUIRE) &&
+      __atomic_exchange_n(&p_render->is_flyback_pending, 0, __ATOMIC_ACQUIRE) &&
+      p_render->p_flyback_callback) {
+    p_render->p_flyback_callback(p_render->p_flyback_callback_object);
+  }
+}
@@ -19,6 +19,13 @@ enum {
   k_render_num_modes = 7,
 };
 
+enum {
+  /* 0xAARRGGBB. */
+  k_render_pixel_format_bgra = 0,
+  /* Physical color, 0-7: bit 0 red, bit 1 green, bit 2 blue. */
+  k_render_pixel_format_index = 1,
+};
+
 struct render_character_2MHz {
   uint32_t host_pixels[8];
 };
@@ -43,6 +50,7 @@ void render_set_flyback_callback(struct render_struct* p_render,
                                  void (*p_flyback_callback)(void* p),
                                  void* p_callback_object);
 
+int render_get_pixel_format(struct render_struct* p_render);
 uint32_t render_get_width(struct render_struct* p_render);
 uint32_t render_get_height(struct render_struct* p_render);
 uint32_t render_get_buffer_size(struct render_struct* p_render);
@@ -53,9 +61,10 @@ void render_create_internal_buffer(struct render_struct* p_render);
 
 void render_set_mode(struct render_struct* p_render, int mode);
 
+/* Color is the physical color, 0-7, as for k_render_pixel_format_index. */
 void render_set_palette(struct render_struct* p_render,
                         uint8_t index,
-                        uint32_t rgba);
+                        uint8_t color);
 void render_set_cursor_segments(struct render_struct* p_render,
                                 int s0,
                                 int s1,
@@ -76,4 +85,13 @@ void render_frame_boundary(struct render_struct* p_render);
 void render_cursor(struct render_struct* p_render);
 void render_set_horiz_beam_pos(struct render_struct* p_render, uint32_t pos);
 
+/* CRTC signals for the SAA5050, which must be ordered with the rendering. */
+void render_teletext_RA_changed(struct render_struct* p_render, uint8_t ra);
+void render_teletext_DISPMTG_changed(struct render_struct* p_render,
+                                     int value);
+void render_teletext_VSYNC_changed(struct render_struct* p_render, int value);
+
+/* With a render thread, publishes queued output to it. */
+void render_flush(struct render_struct* p_render);
+
 #endif /* BEEBJIT_RENDER_H */
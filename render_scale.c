@@ -0,0 +1,211 @@
+#include "render_scale.h"
+
+#include "util.h"
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+struct render_scale_struct {
+  uint32_t src_width;
+  uint32_t src_height;
+  uint32_t dest_width;
+  uint32_t dest_height;
+  /* Whole number horizontal scale factor, or 0 if it's fractional. */
+  uint32_t x_scale;
+  /* Source column for each destination column. */
+  uint32_t* p_src_x;
+  /* Source row and brightness (out of 256) for each destination row. */
+  uint32_t* p_src_y;
+  uint32_t* p_row_weight;
+};
+
+struct render_scale_struct*
+render_scale_create(uint32_t src_width,
+                    uint32_t src_height,
+                    uint32_t dest_width,
+                    uint32_t dest_height,
+                    uint32_t scanline_percent,
+                    int is_crt) {
+  uint32_t i;
+  uint32_t dark_weight;
+  struct render_scale_struct* p_scale;
+
+  if ((src_width == 0) || (src_height == 0) ||
+      (dest_width == 0) || (dest_height == 0)) {
+    util_bail("bad scale dimensions");
+  }
+  if (scanline_percent > 100) {
+    util_bail("scanlines must be 100 or less");
+  }
+
+  p_scale = util_mallocz(sizeof(struct render_scale_struct));
+  p_scale->src_width = src_width;
+  p_scale->src_height = src_height;
+  p_scale->dest_width = dest_width;
+  p_scale->dest_height = dest_height;
+
+  if ((dest_width % src_width) == 0) {
+    p_scale->x_scale = (dest_width / src_width);
+  }
+
+  /* Sample at the middle of each destination pixel. */
+  p_scale->p_src_x = util_malloc(dest_width * sizeof(uint32_t));
+  for (i = 0; i < dest_width; ++i) {
+    p_scale->p_src_x[i] = ((((uint64_t) i * 2) + 1) * src_width /
+                           ((uint64_t) dest_width * 2));
+  }
+
+  dark_weight = (256 - ((256 * scanline_percent) / 100));
+  p_scale->p_src_y = util_malloc(dest_height * sizeof(uint32_t));
+  p_scale->p_row_weight = util_malloc(dest_height * sizeof(uint32_t));
+  for (i = 0; i < dest_height; ++i) {
+    /* Source position in 1/256ths of a row. A BBC scanline is two rows of
+     * the render buffer, so phase is 0-511 across a scanline.
+     */
+    uint64_t y_pos = ((((uint64_t) i * 2) + 1) * src_height * 256 /
+                      ((uint64_t) dest_height * 2));
+    uint32_t phase = (y_pos % 512);
+    uint32_t weight = 256;
+
+    p_scale->p_src_y[i] = (y_pos / 256);
+    if (is_crt) {
+      uint32_t distance = ((phase >= 256) ? (phase - 256) : (256 - phase));
+      weight = (256 - (((256 - dark_weight) * distance) / 256));
+    } else if (phase >= 256) {
+      weight = dark_weight;
+    }
+    p_scale->p_row_weight[i] = weight;
+  }
+
+  return p_scale;
+}
+
+void
+render_scale_destroy(struct render_scale_struct* p_scale) {
+  util_free(p_scale->p_src_x);
+  util_free(p_scale->p_src_y);
+  util_free(p_scale->p_row_weight);
+  util_free(p_scale);
+}
+
+static void
+render_scale_row(struct render_scale_struct* p_scale,
+                 uint32_t* p_dest,
+                 uint32_t* p_src) {
+  uint32_t i;
+  uint32_t j;
+
+  uint32_t src_width = p_scale->src_width;
+  uint32_t dest_width = p_scale->dest_width;
+  uint32_t x_scale = p_scale->x_scale;
+
+  if (x_scale == 1) {
+    (void) memcpy(p_dest, p_src, (dest_width * sizeof(uint32_t)));
+    return;
+  }
+
+  i = 0;
+#if defined(__x86_64__)
+  if (x_scale == 2) {
+    for (; (i + 4) <= src_width; i += 4) {
+      __m128i pixels = _mm_loadu_si128((__m128i*) &p_src[i]);
+      _mm_storeu_si128((__m128i*) &p_dest[i * 2],
+                       _mm_unpacklo_epi32(pixels, pixels));
+      _mm_storeu_si128((__m128i*) &p_dest[(i * 2) + 4],
+                       _mm_unpackhi_epi32(pixels, pixels));
+    }
+  } else if (x_scale >= 4) {
+    for (; i < src_width; ++i) {
+      __m128i pixels = _mm_set1_epi32(p_src[i]);
+      uint32_t* p_out = &p_dest[i * x_scale];
+      for (j = 0; (j + 4) <= x_scale; j += 4) {
+        _mm_storeu_si128((__m128i*) &p_out[j], pixels);
+      }
+      for (; j < x_scale; ++j) {
+        p_out[j] = p_src[i];
+      }
+    }
+  }
+#endif
+  if (x_scale != 0) {
+    for (; i < src_width; ++i) {
+      uint32_t* p_out = &p_dest[i * x_scale];
+      for (j = 0; j < x_scale; ++j) {
+        p_out[j] = p_src[i];
+      }
+    }
+  } else {
+    uint32_t* p_src_x = p_scale->p_src_x;
+    for (i = 0; i < dest_width; ++i) {
+      p_dest[i] = p_src[p_src_x[i]];
+    }
+  }
+}
+
+static void
+render_scale_shade_row(uint32_t* p_dest, uint32_t width, uint32_t weight) {
+  uint32_t i = 0;
+
+  assert(weight < 256);
+
+#if defined(__x86_64__)
+  {
+    __m128i zero = _mm_setzero_si128();
+    __m128i weights = _mm_set1_epi16(weight);
+    __m128i alpha = _mm_set1_epi32(0xff000000);
+    for (; (i + 4) <= width; i += 4) {
+      __m128i pixels = _mm_loadu_si128((__m128i*) &p_dest[i]);
+      __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+      __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+      lo = _mm_srli_epi16(_mm_mullo_epi16(lo, weights), 8);
+      hi = _mm_srli_epi16(_mm_mullo_epi16(hi, weights), 8);
+      pixels = _mm_or_si128(_mm_packus_epi16(lo, hi), alpha);
+      _mm_storeu_si128((__m128i*) &p_dest[i], pixels);
+    }
+  }
+#endif
+  for (; i < width; ++i) {
+    uint32_t pixel = p_dest[i];
+    uint32_t red = ((((pixel >> 16) & 0xFF) * weight) >> 8);
+    uint32_t green = ((((pixel >> 8) & 0xFF) * weight) >> 8);
+    uint32_t blue = (((pixel & 0xFF) * weight) >> 8);
+    p_dest[i] = (0xff000000 | (red << 16) | (green << 8) | blue);
+  }
+}
+
+void
+render_scale_process(struct render_scale_struct* p_scale,
+                     uint32_t* p_dest,
+                     uint32_t* p_src) {
+  uint32_t i;
+
+  uint32_t src_width = p_scale->src_width;
+  uint32_t dest_width = p_scale->dest_width;
+  uint32_t dest_height = p_scale->dest_height;
+  uint32_t* p_src_y = p_scale->p_src_y;
+  uint32_t* p_row_weight = p_scale->p_row_weight;
+  uint32_t* p_prev_dest = NULL;
+
+  for (i = 0; i < dest_height; ++i) {
+    uint32_t weight = p_row_weight[i];
+
+    /* Scaling up vertically repeats rows, which is just a copy. */
+    if ((p_prev_dest != NULL) &&
+        (p_src_y[i] == p_src_y[i - 1]) &&
+        (weight == p_row_weight[i - 1])) {
+      (void) memcpy(p_dest, p_prev_dest, (dest_width * sizeof(uint32_t)));
+    } else {
+      render_scale_row(p_scale, p_dest, (p_src + (p_src_y[i] * src_width)));
+      if (weight != 256) {
+        render_scale_shade_row(p_dest, dest_width, weight);
+      }
+    }
+
+    p_prev_dest = p_dest;
+    p_dest += dest_width;
+  }
+}
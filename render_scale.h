@@ -0,0 +1,25 @@
+#ifndef BEEBJIT_RENDER_SCALE_H
+#define BEEBJIT_RENDER_SCALE_H
+
+#include <stdint.h>
+
+struct render_scale_struct;
+
+/* Post-render stage: scales a finished render buffer into a differently sized
+ * output buffer, optionally darkening scanlines. scanline_percent is how much
+ * darker the darkest rows get. With is_crt, brightness falls off smoothly
+ * from the middle of each scanline instead of every other row being dark.
+ */
+struct render_scale_struct* render_scale_create(uint32_t src_width,
+                                                uint32_t src_height,
+                                                uint32_t dest_width,
+                                                uint32_t dest_height,
+                                                uint32_t scanline_percent,
+                                                int is_crt);
+void render_scale_destroy(struct render_scale_struct* p_scale);
+
+void render_scale_process(struct render_scale_struct* p_scale,
+                          uint32_t* p_dest,
+                          uint32_t* p_src);
+
+#endif /* BEEBJIT_RENDER_SCALE_H */
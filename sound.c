@@ -1,17 +1,31 @@
 #include "sound.h"
 
 #include "bbc_options.h"
+#include "log.h"
 #include "os_sound.h"
 #include "os_thread.h"
 #include "timing.h"
 #include "util.h"
 
 #include <assert.h>
+#include <inttypes.h>
 #include <math.h>
 
 static const uint32_t k_sound_clock_rate = 250000;
 /* BBC master clock 2MHz, 8x divider for 250kHz sn76489 chip. */
 static const uint32_t k_sound_clock_divider = 8;
+/* Beyond this speed multiplier, the pitch shifted output is not worth hearing
+ * and sound output is silenced.
+ */
+static const double k_sound_max_speed_multiplier = 16.0;
+/* Non-blocking drift control. The resample ratio is nudged by at most 0.5%,
+ * which is a pitch change of under 10 cents, to hold the driver's queue at
+ * half full. The fill level is smoothed over roughly 100 ticks because the
+ * driver only reports it in period sized steps.
+ */
+static const double k_sound_drift_max_adjust = 0.005;
+static const double k_sound_drift_gain = 0.02;
+static const double k_sound_drift_smoothing = 0.01;
 
 enum {
   /* 0-2 square wave tone channels, 3 noise channel. */
@@ -24,12 +38,17 @@ struct sound_struct {
 
   /* Configuration. */
   int synchronous;
+  int is_nonblocking;
   uint32_t driver_buffer_size;
   int is_output_enabled;
+  double speed_multiplier;
 
   /* Calculated configuration. */
+  double base_sn_frames_per_driver_frame;
+  double nominal_sn_frames_per_driver_frame;
   double sn_frames_per_driver_frame;
   uint32_t sn_frames_per_driver_buffer_size;
+  uint32_t sn_frames_capacity;
   int16_t volumes[16];
   int16_t volume_silence;
 
@@ -46,6 +65,12 @@ struct sound_struct {
   double resample_index;
   uint32_t next_sample_start_index;
 
+  /* Drift control. */
+  double drift_ratio;
+  double average_frames_queued;
+  uint64_t num_frames_dropped;
+  uint32_t log_count_dropped;
+
   /* sn76489 state. */
   uint16_t counter[k_sound_num_channels];
   uint8_t output[k_sound_num_channels];
@@ -80,8 +105,7 @@ sound_fill_sn76489_buffer(struct sound_struct* p_sound,
   uint32_t sn_frames_filled = p_sound->sn_frames_filled;
   int16_t volume_silence = p_sound->volume_silence;
 
-  if ((sn_frames_filled + num_frames) >
-      p_sound->sn_frames_per_driver_buffer_size) {
+  if ((sn_frames_filled + num_frames) > p_sound->sn_frames_capacity) {
     util_bail("p_sn_frames overflowed");
   }
 
@@ -292,15 +316,23 @@ sound_create(int synchronous,
   p_sound->thread_running = 0;
   p_sound->do_exit = 0;
   p_sound->is_output_enabled = 1;
+  p_sound->speed_multiplier = 1.0;
 
   p_sound->average_sample_value = 0.0;
   p_sound->average_sample_count = 0.0;
   p_sound->resample_index = 0.0;
   p_sound->next_sample_start_index = 0;
 
+  p_sound->drift_ratio = 1.0;
+  p_sound->average_frames_queued = 0.0;
+  p_sound->num_frames_dropped = 0;
+  p_sound->log_count_dropped = 16;
+
   p_sound->prev_system_ticks = 0;
   p_sound->sn_frames_filled = 0;
 
+  p_sound->is_nonblocking = util_has_option(p_options->p_opt_flags,
+                                            "sound:nonblocking");
   positive_silence = util_has_option(p_options->p_opt_flags,
                                      "sound:positive-silence");
 
@@ -367,14 +399,66 @@ sound_set_driver(struct sound_struct* p_sound,
 
   p_sound->driver_buffer_size = driver_buffer_size;
   /* sn76489 in the BBC ticks at 250kHz (8x divisor on main 2Mhz clock). */
-  p_sound->sn_frames_per_driver_frame = ((double) k_sound_clock_rate /
-                                         (double) sample_rate);
-  p_sound->sn_frames_per_driver_buffer_size =
-      floor(driver_buffer_size * p_sound->sn_frames_per_driver_frame);
+  p_sound->base_sn_frames_per_driver_frame = ((double) k_sound_clock_rate /
+                                              (double) sample_rate);
+  /* Size for the fastest speed multiplier that still outputs sound. */
+  p_sound->sn_frames_capacity =
+      floor(driver_buffer_size *
+            p_sound->base_sn_frames_per_driver_frame *
+            k_sound_max_speed_multiplier);
 
   p_sound->p_driver_frames = util_mallocz(driver_buffer_size * sizeof(int16_t));
   p_sound->p_sn_frames = util_mallocz(
-      p_sound->sn_frames_per_driver_buffer_size * sizeof(int16_t));
+      p_sound->sn_frames_capacity * sizeof(int16_t));
+
+  sound_set_speed_multiplier(p_sound, p_sound->speed_multiplier);
+}
+
+static void
+sound_set_resample_step(struct sound_struct* p_sound) {
+  double sn_frames_per_driver_frame =
+      (p_sound->nominal_sn_frames_per_driver_frame * p_sound->drift_ratio);
+
+  /* The resample carry-over is in sn frames, so the step can change between
+   * chunks without a reset as long as the change is small.
+   */
+  p_sound->sn_frames_per_driver_frame = sn_frames_per_driver_frame;
+  p_sound->sn_frames_per_driver_buffer_size =
+      floor(p_sound->driver_buffer_size * sn_frames_per_driver_frame);
+}
+
+void
+sound_set_speed_multiplier(struct sound_struct* p_sound, double multiplier) {
+  double sn_frames_per_driver_frame;
+
+  p_sound->speed_multiplier = multiplier;
+
+  /* Threaded sound samples the current sound registers in real time, so
+   * doesn't need adjustment, and mustn't be disturbed while running.
+   */
+  if ((p_sound->p_driver == NULL) || p_sound->thread_running) {
+    return;
+  }
+
+  /* Synchronous sound resamples emulated time, so more emulated time is
+   * squeezed into each driver frame when running fast.
+   */
+  sn_frames_per_driver_frame = p_sound->base_sn_frames_per_driver_frame;
+  if (p_sound->synchronous && (multiplier <= k_sound_max_speed_multiplier)) {
+    sn_frames_per_driver_frame *= multiplier;
+  }
+
+  p_sound->nominal_sn_frames_per_driver_frame = sn_frames_per_driver_frame;
+  sound_set_resample_step(p_sound);
+
+  /* Resampling carry-over is in units of the old step, so drop it along with
+   * any pending frames. This costs a sub-millisecond glitch.
+   */
+  p_sound->sn_frames_filled = 0;
+  p_sound->average_sample_value = 0.0;
+  p_sound->average_sample_count = 0.0;
+  p_sound->resample_index = 0.0;
+  p_sound->next_sample_start_index = 0;
 }
 
 void
@@ -454,6 +538,9 @@ sound_is_active(struct sound_struct* p_sound) {
   if (p_sound->p_driver == NULL) {
     return 0;
   }
+  if (p_sound->speed_multiplier > k_sound_max_speed_multiplier) {
+    return 0;
+  }
   return p_sound->is_output_enabled;
 }
 
@@ -462,6 +549,14 @@ sound_is_synchronous(struct sound_struct* p_sound) {
   return p_sound->synchronous;
 }
 
+int
+sound_is_blocking(struct sound_struct* p_sound) {
+  if (!sound_is_active(p_sound)) {
+    return 0;
+  }
+  return (p_sound->synchronous && !p_sound->is_nonblocking);
+}
+
 static void
 sound_advance_sn_timing(struct sound_struct* p_sound) {
   uint64_t prev_sn_ticks;
@@ -494,6 +589,56 @@ sound_advance_sn_timing(struct sound_struct* p_sound) {
   p_sound->prev_system_ticks = curr_system_ticks;
 }
 
+static uint32_t
+sound_apply_drift_control(struct sound_struct* p_sound,
+                          uint32_t num_driver_frames) {
+  double error;
+  double drift_ratio;
+  uint32_t frames_free;
+
+  uint32_t driver_buffer_size = p_sound->driver_buffer_size;
+  uint32_t frames_queued = os_sound_get_frames_queued(p_sound->p_driver);
+
+  if (frames_queued > driver_buffer_size) {
+    frames_queued = driver_buffer_size;
+  }
+  frames_free = (driver_buffer_size - frames_queued);
+
+  /* Emulated time is paced by the host clock, which drifts against the sound
+   * device's clock. Too many queued frames means emulated time is producing
+   * frames faster than the device plays them, so squeeze a little more
+   * emulated time into each driver frame, and vice versa.
+   */
+  p_sound->average_frames_queued +=
+      ((frames_queued - p_sound->average_frames_queued) *
+       k_sound_drift_smoothing);
+  error = ((p_sound->average_frames_queued - (driver_buffer_size / 2.0)) /
+           driver_buffer_size);
+  drift_ratio = (1.0 + (error * k_sound_drift_gain));
+  if (drift_ratio > (1.0 + k_sound_drift_max_adjust)) {
+    drift_ratio = (1.0 + k_sound_drift_max_adjust);
+  } else if (drift_ratio < (1.0 - k_sound_drift_max_adjust)) {
+    drift_ratio = (1.0 - k_sound_drift_max_adjust);
+  }
+  p_sound->drift_ratio = drift_ratio;
+  sound_set_resample_step(p_sound);
+
+  /* Never write more than fits, so the write doesn't block. This only drops
+   * frames after a host stall, when they would be late anyway.
+   */
+  if (num_driver_frames > frames_free) {
+    p_sound->num_frames_dropped += (num_driver_frames - frames_free);
+    log_do_log_max_count(&p_sound->log_count_dropped,
+                         k_log_audio,
+                         k_log_info,
+                         "driver queue full, %"PRIu64" frames dropped so far",
+                         p_sound->num_frames_dropped);
+    num_driver_frames = frames_free;
+  }
+
+  return num_driver_frames;
+}
+
 void
 sound_tick(struct sound_struct* p_sound) {
   uint32_t num_driver_frames;
@@ -510,6 +655,9 @@ sound_tick(struct sound_struct* p_sound) {
   sound_advance_sn_timing(p_sound);
 
   num_driver_frames = sound_resample_to_driver_buffer(p_sound);
+  if (p_sound->is_nonblocking) {
+    num_driver_frames = sound_apply_drift_control(p_sound, num_driver_frames);
+  }
   os_sound_write(p_driver, p_sound->p_driver_frames, num_driver_frames);
 }
 
@@ -124,6 +124,12 @@ state_6502_set_y(struct state_6502* p_state_6502, uint8_t val) {
   *((uint8_t*) p_y) = val;
 }
 
+void
+state_6502_set_s(struct state_6502* p_state_6502, uint8_t val) {
+  uint32_t* p_s = &p_state_6502->reg_s;
+  *((uint8_t*) p_s) = val;
+}
+
 static int
 state_6502_irq_is_edge_triggered(int irq) {
   if (irq == k_state_6502_irq_nmi) {
@@ -0,0 +1,323 @@
+#include "state_hash.h"
+
+#include "bbc.h"
+#include "log.h"
+#include "sound.h"
+#include "util.h"
+#include "via.h"
+#include "video.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+
+static const char* k_state_hash_log_magic = "BJHASH01";
+
+enum {
+  k_state_hash_page_size = 256,
+  k_state_hash_num_pages = (k_bbc_ram_size / k_state_hash_page_size),
+  k_state_hash_header_size = 8,
+  k_state_hash_record_size = 16,
+};
+
+struct state_hash_struct {
+  struct bbc_struct* p_bbc;
+  struct util_file* p_file;
+
+  /* Copy of RAM as of the last checkpoint, and per-page hashes. Only pages
+   * which differ from the copy get hashed again.
+   */
+  uint8_t ram_copy[k_bbc_ram_size];
+  uint32_t page_hashes[k_state_hash_num_pages];
+};
+
+static uint32_t
+state_hash_get_page_hash(uint8_t* p_page) {
+  uint32_t crc = util_crc32_init();
+  crc = util_crc32_add(crc, p_page, k_state_hash_page_size);
+  return util_crc32_finish(crc);
+}
+
+struct state_hash_struct*
+state_hash_create(struct bbc_struct* p_bbc) {
+  uint32_t i;
+
+  struct state_hash_struct* p_state_hash =
+      util_mallocz(sizeof(struct state_hash_struct));
+
+  p_state_hash->p_bbc = p_bbc;
+
+  for (i = 0; i < k_state_hash_num_pages; ++i) {
+    uint8_t* p_page = &p_state_hash->ram_copy[i * k_state_hash_page_size];
+    p_state_hash->page_hashes[i] = state_hash_get_page_hash(p_page);
+  }
+
+  return p_state_hash;
+}
+
+void
+state_hash_destroy(struct state_hash_struct* p_state_hash) {
+  if (p_state_hash->p_file != NULL) {
+    util_file_close(p_state_hash->p_file);
+  }
+  util_free(p_state_hash);
+}
+
+void
+state_hash_set_log_file(struct state_hash_struct* p_state_hash,
+                        const char* p_file_name) {
+  assert(p_state_hash->p_file == NULL);
+
+  p_state_hash->p_file = util_file_open(p_file_name, 1, 1);
+  util_file_write(p_state_hash->p_file,
+                  k_state_hash_log_magic,
+                  k_state_hash_header_size);
+}
+
+static uint32_t
+state_hash_get_ram_hash(struct state_hash_struct* p_state_hash) {
+  uint32_t i;
+  uint32_t crc;
+
+  uint8_t* p_mem_read = bbc_get_mem_read(p_state_hash->p_bbc);
+
+  for (i = 0; i < k_state_hash_num_pages; ++i) {
+    size_t offset = (i * k_state_hash_page_size);
+    uint8_t* p_copy = &p_state_hash->ram_copy[offset];
+    if (memcmp(p_copy, (p_mem_read + offset), k_state_hash_page_size) == 0) {
+      continue;
+    }
+    (void) memcpy(p_copy, (p_mem_read + offset), k_state_hash_page_size);
+    p_state_hash->page_hashes[i] = state_hash_get_page_hash(p_copy);
+  }
+
+  crc = util_crc32_init();
+  crc = util_crc32_add(crc,
+                       (uint8_t*) &p_state_hash->page_hashes[0],
+                       sizeof(p_state_hash->page_hashes));
+  return util_crc32_finish(crc);
+}
+
+static uint32_t
+state_hash_add_via(uint32_t crc, struct via_struct* p_via) {
+  uint8_t regs[14];
+  int32_t counters[4];
+
+  via_get_registers(p_via,
+                    &regs[0],
+                    &regs[1],
+                    &regs[2],
+                    &regs[3],
+                    &regs[4],
+                    &regs[5],
+                    &regs[6],
+                    &regs[7],
+                    &regs[8],
+                    &regs[9],
+                    &regs[10],
+                    &counters[0],
+                    &counters[1],
+                    &counters[2],
+                    &counters[3],
+                    &regs[11],
+                    &regs[12],
+                    &regs[13]);
+  crc = util_crc32_add(crc, regs, sizeof(regs));
+  crc = util_crc32_add(crc, (uint8_t*) counters, sizeof(counters));
+
+  return crc;
+}
+
+static uint32_t
+state_hash_get_peripheral_hash(struct state_hash_struct* p_state_hash) {
+  uint8_t regs[k_video_crtc_num_registers + 16 + 3];
+  uint8_t volumes[4];
+  uint16_t periods[4];
+  uint16_t counters[4];
+  uint8_t outputs[4];
+  uint8_t last_channel;
+  int noise_type;
+  uint8_t noise_frequency;
+  uint16_t noise_rng;
+  uint32_t crc;
+
+  struct bbc_struct* p_bbc = p_state_hash->p_bbc;
+  struct video_struct* p_video = bbc_get_video(p_bbc);
+
+  /* NOTE: the CPU registers are not included. The CPU drivers keep them in
+   * host registers or locals and only write them back to the 6502 state on
+   * exit or debug entry, not for timer callbacks. Any register divergence
+   * soon shows up in RAM anyway.
+   * For the same reason of lazy updates, only the sound chip's registers are
+   * included, not its counters.
+   */
+  video_get_crtc_registers(p_video, &regs[0]);
+  video_get_ula_full_palette(p_video, &regs[k_video_crtc_num_registers]);
+  regs[k_video_crtc_num_registers + 16] = video_get_ula_control(p_video);
+  regs[k_video_crtc_num_registers + 17] = bbc_get_romsel(p_bbc);
+  regs[k_video_crtc_num_registers + 18] = bbc_get_acccon(p_bbc);
+
+  sound_get_state(bbc_get_sound(p_bbc),
+                  &volumes[0],
+                  &periods[0],
+                  &counters[0],
+                  &outputs[0],
+                  &last_channel,
+                  &noise_type,
+                  &noise_frequency,
+                  &noise_rng);
+
+  crc = util_crc32_init();
+  crc = util_crc32_add(crc, regs, sizeof(regs));
+  crc = util_crc32_add(crc, volumes, sizeof(volumes));
+  crc = util_crc32_add(crc, (uint8_t*) periods, sizeof(periods));
+  crc = util_crc32_add(crc, &noise_frequency, 1);
+  crc = state_hash_add_via(crc, bbc_get_sysvia(p_bbc));
+  crc = state_hash_add_via(crc, bbc_get_uservia(p_bbc));
+
+  return util_crc32_finish(crc);
+}
+
+static void
+state_hash_write_le(uint8_t* p_buf, uint64_t val, uint32_t len) {
+  uint32_t i;
+  for (i = 0; i < len; ++i) {
+    p_buf[i] = (val & 0xFF);
+    val >>= 8;
+  }
+}
+
+static uint64_t
+state_hash_read_le(uint8_t* p_buf, uint32_t len) {
+  uint32_t i;
+  uint64_t val = 0;
+  for (i = 0; i < len; ++i) {
+    val |= ((uint64_t) p_buf[i] << (i * 8));
+  }
+  return val;
+}
+
+void
+state_hash_checkpoint(struct state_hash_struct* p_state_hash,
+                      uint64_t cycles) {
+  uint8_t record[k_state_hash_record_size];
+
+  uint32_t ram_hash = state_hash_get_ram_hash(p_state_hash);
+  uint32_t peripheral_hash = state_hash_get_peripheral_hash(p_state_hash);
+
+  log_do_log(k_log_misc,
+             k_log_info,
+             "state hash at cycles %"PRIu64": %.8X %.8X",
+             cycles,
+             ram_hash,
+             peripheral_hash);
+
+  if (p_state_hash->p_file == NULL) {
+    return;
+  }
+
+  state_hash_write_le(&record[0], cycles, 8);
+  state_hash_write_le(&record[8], ram_hash, 4);
+  state_hash_write_le(&record[12], peripheral_hash, 4);
+  util_file_write(p_state_hash->p_file, record, sizeof(record));
+}
+
+static uint8_t*
+state_hash_load_log(uint64_t* p_num_records, const char* p_file_name) {
+  uint8_t* p_buf;
+  uint64_t size;
+
+  struct util_file* p_file = util_file_open(p_file_name, 0, 0);
+
+  size = util_file_get_size(p_file);
+  if ((size < k_state_hash_header_size) ||
+      (((size - k_state_hash_header_size) % k_state_hash_record_size) != 0)) {
+    util_bail("bad state hash log size: %s", p_file_name);
+  }
+  p_buf = util_malloc(size);
+  if (util_file_read(p_file, p_buf, size) != size) {
+    util_bail("state hash log read failed: %s", p_file_name);
+  }
+  util_file_close(p_file);
+
+  if (memcmp(p_buf, k_state_hash_log_magic, k_state_hash_header_size) != 0) {
+    util_bail("not a state hash log: %s", p_file_name);
+  }
+
+  *p_num_records = ((size - k_state_hash_header_size) /
+                    k_state_hash_record_size);
+  return (p_buf + k_state_hash_header_size);
+}
+
+int
+state_hash_compare_logs(const char* p_file_name_1,
+                        const char* p_file_name_2) {
+  uint64_t num_records_1;
+  uint64_t num_records_2;
+  uint64_t num_records;
+  uint64_t i;
+
+  uint8_t* p_records_1 = state_hash_load_log(&num_records_1, p_file_name_1);
+  uint8_t* p_records_2 = state_hash_load_log(&num_records_2, p_file_name_2);
+  uint64_t last_cycles = 0;
+  int ret = 0;
+
+  num_records = num_records_1;
+  if (num_records_2 < num_records) {
+    num_records = num_records_2;
+  }
+
+  for (i = 0; i < num_records; ++i) {
+    uint8_t* p_record_1 = (p_records_1 + (i * k_state_hash_record_size));
+    uint8_t* p_record_2 = (p_records_2 + (i * k_state_hash_record_size));
+    uint64_t cycles_1 = state_hash_read_le(&p_record_1[0], 8);
+    uint64_t cycles_2 = state_hash_read_le(&p_record_2[0], 8);
+    int is_ram_same = !memcmp(&p_record_1[8], &p_record_2[8], 4);
+    int is_peripheral_same = !memcmp(&p_record_1[12], &p_record_2[12], 4);
+
+    if (cycles_1 != cycles_2) {
+      log_do_log(k_log_misc,
+                 k_log_info,
+                 "checkpoint %"PRIu64" at different cycles: %"PRIu64
+                 " vs. %"PRIu64,
+                 i,
+                 cycles_1,
+                 cycles_2);
+      ret = 1;
+      break;
+    }
+    if (!is_ram_same || !is_peripheral_same) {
+      log_do_log(k_log_misc,
+                 k_log_info,
+                 "diverged between cycles %"PRIu64" and %"PRIu64" (%s%s%s)",
+                 last_cycles,
+                 cycles_1,
+                 (is_ram_same ? "" : "RAM"),
+                 ((is_ram_same || is_peripheral_same) ? "" : ", "),
+                 (is_peripheral_same ? "" : "peripherals"));
+      ret = 1;
+      break;
+    }
+    last_cycles = cycles_1;
+  }
+
+  if (ret == 0) {
+    if (num_records_1 != num_records_2) {
+      log_do_log(k_log_misc,
+                 k_log_info,
+                 "identical to cycles %"PRIu64", then one log ends",
+                 last_cycles);
+      ret = 1;
+    } else {
+      log_do_log(k_log_misc,
+                 k_log_info,
+                 "identical across %"PRIu64" checkpoints",
+                 num_records);
+    }
+  }
+
+  util_free(p_records_1 - k_state_hash_header_size);
+  util_free(p_records_2 - k_state_hash_header_size);
+
+  return ret;
+}
@@ -0,0 +1,20 @@
+#ifndef BEEBJIT_STATE_HASH_H
+#define BEEBJIT_STATE_HASH_H
+
+#include <stdint.h>
+
+struct bbc_struct;
+struct state_hash_struct;
+
+struct state_hash_struct* state_hash_create(struct bbc_struct* p_bbc);
+void state_hash_destroy(struct state_hash_struct* p_state_hash);
+
+void state_hash_set_log_file(struct state_hash_struct* p_state_hash,
+                             const char* p_file_name);
+void state_hash_checkpoint(struct state_hash_struct* p_state_hash,
+                           uint64_t cycles);
+
+int state_hash_compare_logs(const char* p_file_name_1,
+                            const char* p_file_name_2);
+
+#endif /* BEEBJIT_STATE_HASH_H */
@@ -48,6 +48,10 @@ static uint8_t s_teletext_generated_gfx[96 * 16 * 20];
 static uint8_t s_teletext_generated_sep_gfx[96 * 16 * 20];
 
 struct teletext_struct {
+  /* Either color multipliers for blending 0-255 glyph intensities into BGRA,
+   * or just the physical color when rendering palette indexes.
+   */
+  int is_indexed;
   uint32_t palette[8];
   uint32_t flash_count;
   int flash_visible_this_frame;
@@ -326,6 +330,22 @@ teletext_destroy(struct teletext_struct* p_teletext) {
   util_free(p_teletext);
 }
 
+void
+teletext_set_is_indexed(struct teletext_struct* p_teletext, int is_indexed) {
+  uint32_t i;
+
+  if (!is_indexed) {
+    return;
+  }
+
+  p_teletext->is_indexed = 1;
+  for (i = 0; i < 8; ++i) {
+    p_teletext->palette[i] = i;
+  }
+  p_teletext->fg_color = p_teletext->palette[7];
+  p_teletext->bg_color = p_teletext->palette[0];
+}
+
 static inline void
 teletext_handle_control_character(struct teletext_struct* p_teletext,
                                   uint32_t* p_fg_color,
@@ -490,6 +510,24 @@ teletext_render_data(struct teletext_struct* p_teletext,
 
   bg_color = p_teletext->bg_color;
 
+  if (p_teletext->is_indexed) {
+    /* No blending, so threshold the smoothed glyph. */
+    for (i = 0; i < 16; ++i) {
+      p_out->host_pixels[i] = ((p_src_data[i] & 0x80) ? fg_color : bg_color);
+    }
+    if (p_next_out != NULL) {
+      assert(do_deinterlace);
+      if (!p_teletext->double_active) {
+        p_src_data += 16;
+      }
+      for (i = 0; i < 16; ++i) {
+        p_next_out->host_pixels[i] =
+            ((p_src_data[i] & 0x80) ? fg_color : bg_color);
+      }
+    }
+    return;
+  }
+
   for (i = 0; i < 16; ++i) {
     uint32_t color;
     uint8_t val = p_src_data[i];
@@ -11,6 +11,9 @@ struct video_struct;
 struct teletext_struct* teletext_create();
 void teletext_destroy(struct teletext_struct* p_teletext);
 
+void teletext_set_is_indexed(struct teletext_struct* p_teletext,
+                             int is_indexed);
+
 void teletext_render_data(struct teletext_struct* p_teletext,
                           int do_deinterlace,
                           struct render_character_1MHz* p_out,
@@ -35,7 +35,10 @@ jit_is_jit_ptr_dyanmic(struct jit_struct* p_jit, uint16_t addr_6502) {
 
 static void
 jit_test_expect_block_invalidated(int expect, uint16_t block_addr) {
-  void* p_host_address = jit_get_jit_block_host_address(s_p_jit, block_addr);
+  void* p_host_address;
+  /* A page not yet populated is all invalidated once populated. */
+  jit_ensure_page_populated(s_p_jit, block_addr);
+  p_host_address = jit_get_jit_block_host_address(s_p_jit, block_addr);
   test_expect_u32(expect,
                   jit_is_host_address_invalidated(s_p_jit, p_host_address));
 }
@@ -749,6 +752,208 @@ jit_test_sub_instruction() {
   util_buffer_destroy(p_buf);
 }
 
+static void
+jit_test_unchecked_writes() {
+  struct util_buffer* p_buf = util_buffer_create();
+
+  /* A store to a page without code skips invalidation. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x1E00), 0x100);
+  emit_LDA(p_buf, k_imm, 0xEA);
+  emit_STA(p_buf, k_abs, 0x3001);
+  emit_EXIT(p_buf);
+
+  state_6502_set_pc(s_p_state_6502, 0x1E00);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  jit_test_expect_block_invalidated(0, 0x1E00);
+
+  /* Compiling code into that page invalidates everything. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x3000), 0x100);
+  emit_NOP(p_buf);
+  emit_NOP(p_buf);
+  emit_EXIT(p_buf);
+
+  state_6502_set_pc(s_p_state_6502, 0x3000);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  jit_test_expect_block_invalidated(1, 0x1E00);
+  jit_test_expect_block_invalidated(0, 0x3000);
+
+  /* And the store now invalidates. */
+  state_6502_set_pc(s_p_state_6502, 0x1E00);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  jit_test_expect_code_invalidated(1, 0x3001);
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_irq_check_hoist() {
+  struct util_buffer* p_buf = util_buffer_create();
+
+  /* All the pending IRQ checks in a block without branches share a single
+   * check at the block start.
+   */
+  util_buffer_setup(p_buf, (s_p_mem + 0x1F00), 0x100);
+  emit_SEI(p_buf);
+  emit_CLI(p_buf);
+  emit_SEI(p_buf);
+  emit_CLI(p_buf);
+  emit_SEI(p_buf);
+  emit_EXIT(p_buf);
+
+  state_6502_set_pc(s_p_state_6502, 0x1F00);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+
+  test_expect_u32(0, jit_compiler_is_irq_check_site(s_p_compiler, 0x1F00));
+  test_expect_u32(1, jit_compiler_is_irq_check_site(s_p_compiler, 0x1F01));
+  test_expect_u32(0, jit_compiler_is_irq_check_site(s_p_compiler, 0x1F02));
+  test_expect_u32(1, jit_compiler_is_irq_check_site(s_p_compiler, 0x1F03));
+  test_expect_u32(1, !!(s_p_state_6502->reg_flags & (1 << k_flag_interrupt)));
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_stack_fusion() {
+  uint8_t s;
+  struct util_buffer* p_buf = util_buffer_create();
+
+  /* A PHA / PLA pair doesn't touch S, and a JSR / RTS pair returns through a
+   * host call frame.
+   */
+  util_buffer_setup(p_buf, (s_p_mem + 0x2000), 0x100);
+  emit_LDA(p_buf, k_imm, 0x01);
+  emit_PHA(p_buf);
+  emit_LDA(p_buf, k_imm, 0xAA);
+  emit_PLA(p_buf);
+  emit_JSR(p_buf, 0x2080);
+  emit_STA(p_buf, k_zpg, 0x72);
+  emit_EXIT(p_buf);
+  util_buffer_setup(p_buf, (s_p_mem + 0x2080), 0x80);
+  emit_LDX(p_buf, k_imm, 0x42);
+  emit_RTS(p_buf);
+
+  s = (uint8_t) s_p_state_6502->reg_s;
+  state_6502_set_pc(s_p_state_6502, 0x2000);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x01, s_p_mem[0x72]);
+  test_expect_u32(0x42, s_p_state_6502->reg_x);
+  test_expect_u32(s, (uint8_t) s_p_state_6502->reg_s);
+
+  /* Bailing to the interpreter between the pair fixes up S. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x2100), 0x100);
+  emit_LDA(p_buf, k_imm, 0x02);
+  emit_PHA(p_buf);
+  emit_LDA(p_buf, k_imm, 0x00);
+  emit_LDY(p_buf, k_imm, 0x00);
+  /* Hardware register write: faults in the JIT. */
+  emit_STA(p_buf, k_idy, 0x70);
+  emit_PLA(p_buf);
+  emit_STA(p_buf, k_zpg, 0x72);
+  emit_EXIT(p_buf);
+  s_p_mem[0x70] = 0x6E;
+  s_p_mem[0x71] = 0xFE;
+
+  state_6502_set_pc(s_p_state_6502, 0x2100);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x02, s_p_mem[0x72]);
+  test_expect_u32(s, (uint8_t) s_p_state_6502->reg_s);
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_zpg_forwarding() {
+  struct util_buffer* p_buf = util_buffer_create();
+
+  /* Zero page loads of values already in a register become transfers, and
+   * a zero page store overwritten before it could be read is dropped.
+   */
+  util_buffer_setup(p_buf, (s_p_mem + 0x2300), 0x100);
+  emit_LDA(p_buf, k_imm, 0x11);
+  emit_STA(p_buf, k_zpg, 0x76);
+  emit_LDA(p_buf, k_imm, 0x22);
+  emit_STA(p_buf, k_zpg, 0x76);
+  emit_LDX(p_buf, k_zpg, 0x76);
+  emit_INC(p_buf, k_zpg, 0x76);
+  emit_LDY(p_buf, k_zpg, 0x76);
+  emit_STY(p_buf, k_zpg, 0x77);
+  emit_STX(p_buf, k_zpg, 0x78);
+  emit_EXIT(p_buf);
+
+  state_6502_set_pc(s_p_state_6502, 0x2300);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x23, s_p_mem[0x76]);
+  test_expect_u32(0x23, s_p_mem[0x77]);
+  test_expect_u32(0x22, s_p_mem[0x78]);
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_known_index() {
+  struct util_buffer* p_buf = util_buffer_create();
+
+  /* Indexed accesses with a known index register become direct accesses. */
+  util_buffer_setup(p_buf, (s_p_mem + 0x2400), 0x100);
+  emit_LDX(p_buf, k_imm, 0x05);
+  emit_LDY(p_buf, k_imm, 0x16);
+  emit_LDA(p_buf, k_abx, 0x24F0);
+  emit_STA(p_buf, k_zpx, 0x7A);
+  emit_LDA(p_buf, k_aby, 0x24F0);
+  emit_STA(p_buf, k_aby, 0x006A);
+  emit_INC(p_buf, k_zpx, 0x7A);
+  emit_EXIT(p_buf);
+  s_p_mem[0x24F5] = 0x31;
+  s_p_mem[0x2506] = 0x40;
+
+  state_6502_set_pc(s_p_state_6502, 0x2400);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x32, s_p_mem[0x7F]);
+  test_expect_u32(0x40, s_p_mem[0x80]);
+
+  util_buffer_destroy(p_buf);
+}
+
+static void
+jit_test_jmp_ind_predicted() {
+  struct util_buffer* p_buf = util_buffer_create();
+
+  /* The inline cache is seeded with the vector as of compile time, and a
+   * changed vector still jumps to the right place.
+   */
+  util_buffer_setup(p_buf, (s_p_mem + 0x2200), 0x100);
+  emit_JMP(p_buf, k_ind, 0x0074);
+  util_buffer_setup(p_buf, (s_p_mem + 0x2280), 0x40);
+  emit_LDX(p_buf, k_imm, 0x01);
+  emit_EXIT(p_buf);
+  util_buffer_setup(p_buf, (s_p_mem + 0x22C0), 0x40);
+  emit_LDX(p_buf, k_imm, 0x02);
+  emit_EXIT(p_buf);
+  s_p_mem[0x74] = 0x80;
+  s_p_mem[0x75] = 0x22;
+
+  state_6502_set_pc(s_p_state_6502, 0x2200);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x01, s_p_state_6502->reg_x);
+
+  s_p_mem[0x74] = 0xC0;
+  state_6502_set_pc(s_p_state_6502, 0x2200);
+  jit_enter(s_p_cpu_driver);
+  interp_testing_unexit(s_p_interp);
+  test_expect_u32(0x02, s_p_state_6502->reg_x);
+
+  util_buffer_destroy(p_buf);
+}
+
 void
 jit_test(struct bbc_struct* p_bbc) {
   jit_test_init(p_bbc);
@@ -782,4 +987,16 @@ jit_test(struct bbc_struct* p_bbc) {
   jit_compiler_testing_set_sub_instruction(s_p_compiler, 1);
   jit_test_sub_instruction();
   jit_compiler_testing_set_sub_instruction(s_p_compiler, 0);
+
+  jit_test_unchecked_writes();
+  jit_test_irq_check_hoist();
+  jit_test_jmp_ind_predicted();
+
+  jit_compiler_testing_set_optimizing(s_p_compiler, 1);
+  jit_compiler_testing_set_max_ops(s_p_compiler, 1024);
+  jit_test_stack_fusion();
+  jit_test_zpg_forwarding();
+  jit_test_known_index();
+  jit_compiler_testing_set_max_ops(s_p_compiler, 4);
+  jit_compiler_testing_set_optimizing(s_p_compiler, 0);
 }
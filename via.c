@@ -50,6 +50,7 @@ struct via_struct {
   void* p_CB2_changed_object;
   void (*p_timing_advancer)(void* p, uint64_t ticks);
   void* p_timing_advancer_object;
+  uint8_t* p_snapshot;
 
   uint8_t IRA;
   uint8_t IRB;
@@ -73,6 +74,30 @@ struct via_struct {
   int CB2;
 };
 
+static void
+via_update_snapshot(struct via_struct* p_via) {
+  uint32_t i;
+  uint8_t* p_snapshot = p_via->p_snapshot;
+
+  if (p_snapshot == NULL) {
+    return;
+  }
+
+  /* The registers are mirrored twice across the 32 byte VIA region. */
+  for (i = 0; i < 2; ++i) {
+    p_snapshot[k_via_DDRB] = p_via->DDRB;
+    p_snapshot[k_via_DDRA] = p_via->DDRA;
+    p_snapshot[k_via_T1LL] = (p_via->T1L & 0xFF);
+    p_snapshot[k_via_T1LH] = (p_via->T1L >> 8);
+    p_snapshot[k_via_SR] = p_via->SR;
+    p_snapshot[k_via_ACR] = p_via->ACR;
+    p_snapshot[k_via_PCR] = p_via->PCR;
+    p_snapshot[k_via_IFR] = p_via->IFR;
+    p_snapshot[k_via_IER] = (p_via->IER | 0x80);
+    p_snapshot += 0x10;
+  }
+}
+
 static void
 via_check_interrupt(struct via_struct* p_via) {
   int level;
@@ -88,6 +113,7 @@ via_check_interrupt(struct via_struct* p_via) {
     p_via->IFR &= ~0x80;
     level = 0;
   }
+  via_update_snapshot(p_via);
   if (p_via->id == k_via_system) {
     interrupt = k_state_6502_irq_via_1;
   } else {
@@ -394,6 +420,8 @@ via_power_on_reset(struct via_struct* p_via) {
   p_via->T1L = 0xFFFF;
   via_set_t2c(p_via, 0xFFFF);
   p_via->T2L = 0xFFFF;
+
+  via_update_snapshot(p_via);
 }
 
 void
@@ -405,6 +433,30 @@ via_set_CB2_changed_callback(struct via_struct* p_via,
   p_via->p_CB2_changed_object = p_CB2_changed_object;
 }
 
+void
+via_set_register_snapshot(struct via_struct* p_via, uint8_t* p_snapshot) {
+  p_via->p_snapshot = p_snapshot;
+  via_update_snapshot(p_via);
+}
+
+int
+via_is_register_snapshotted(uint8_t reg) {
+  switch (reg & 0xF) {
+  case k_via_DDRB:
+  case k_via_DDRA:
+  case k_via_T1LL:
+  case k_via_T1LH:
+  case k_via_SR:
+  case k_via_ACR:
+  case k_via_PCR:
+  case k_via_IFR:
+  case k_via_IER:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
 void
 via_set_timing_advancer(struct via_struct* p_via,
                         void (*p_timing_advancer)(void* p, uint64_t ticks),
@@ -926,6 +978,8 @@ via_write(struct via_struct* p_via, uint8_t reg, uint8_t val) {
     break;
   }
 
+  via_update_snapshot(p_via);
+
   via_advance_ticks(p_via, 1);
 }
 
@@ -1082,4 +1136,6 @@ void via_set_registers(struct via_struct* p_via,
   timing_set_firing(p_timing, p_via->t1_timer_id, !t1_oneshot_fired);
   timing_set_firing(p_timing, p_via->t2_timer_id, !t2_oneshot_fired);
   p_via->t1_pb7 = t1_pb7;
+
+  via_update_snapshot(p_via);
 }
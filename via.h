@@ -30,6 +30,12 @@ void via_set_timing_advancer(struct via_struct* p_via,
                              void (*p_timing_advancer)(void* p, uint64_t ticks),
                              void* p_timing_advancer_object);
 
+/* Registers which can be read without side effects are mirrored into a
+ * 32 byte snapshot, so that memory accessors may read them directly.
+ */
+void via_set_register_snapshot(struct via_struct* p_via, uint8_t* p_snapshot);
+int via_is_register_snapshotted(uint8_t reg);
+
 void via_apply_wall_time_delta(struct via_struct* p_via, uint64_t delta);
 
 uint8_t via_read(struct via_struct* p_via, uint8_t reg);
@@ -87,6 +87,7 @@ struct video_struct {
   void (*p_framebuffer_ready_callback)(void*, int, int);
   void* p_framebuffer_ready_object;
   int* p_fast_flag;
+  int is_paint_throttled;
 
   int log_timer;
   uint32_t log_count_horiz_total;
@@ -100,6 +101,22 @@ struct video_struct {
   uint64_t last_wall_time_vsync_hit_cycles;
   int is_rendering_active;
   int has_paint_timer_triggered;
+  /* Full frame render address translation, only touched by whichever thread
+   * does the full frame render. One entry per displayed character: the
+   * scanline 0 address, and in the top half, the mask for adding the
+   * scanline (7 for bitmapped addressing, 0 for MODE7 addressing). Rebuilt
+   * when the start address, screen size or wrap changes.
+   */
+  uint32_t* p_full_frame_addresses;
+  uint32_t full_frame_addresses_size;
+  uint32_t full_frame_start_address;
+  uint32_t full_frame_num_rows;
+  uint32_t full_frame_num_cols;
+  uint32_t full_frame_screen_wrap_add;
+  /* Nobody looks at frames before this tick count, so rendering stays off
+   * until shortly before. UINT64_MAX if frames are never looked at.
+   */
+  uint64_t first_observed_ticks;
 
   /* Options. */
   uint32_t frames_skip;
@@ -173,11 +190,10 @@ struct video_struct {
   int64_t last_vsync_lower_ticks;
 };
 
-static inline uint8_t
-video_read_data_byte(struct video_struct* p_video,
-                     uint32_t address_counter,
-                     uint8_t scanline_counter,
-                     uint32_t screen_wrap_add) {
+static inline uint32_t
+video_get_data_address(struct video_struct* p_video,
+                       uint32_t address_counter,
+                       uint32_t screen_wrap_add) {
   uint32_t address;
 
   /* If MA13 set => MODE7 style addressing. */
@@ -189,9 +205,10 @@ video_read_data_byte(struct video_struct* p_video,
       address = (0x3C00 | (address_counter & 0x3FF));
     }
   } else {
-    /* Normal bitmapped mode. */
+    /* Normal bitmapped mode. The scanline is added by the caller; it can't
+     * carry because the wrap amounts are multiples of 8.
+     */
     address = (address_counter * 8);
-    address += (scanline_counter & 0x7);
     if (address_counter & 0x1000) {
       /* MA12 set => screen address wrap around. */
       address -= screen_wrap_add;
@@ -199,6 +216,21 @@ video_read_data_byte(struct video_struct* p_video,
     address &= 0x7FFF;
   }
 
+  return address;
+}
+
+static inline uint8_t
+video_read_data_byte(struct video_struct* p_video,
+                     uint32_t address_counter,
+                     uint8_t scanline_counter,
+                     uint32_t screen_wrap_add) {
+  uint32_t address = video_get_data_address(p_video,
+                                            address_counter,
+                                            screen_wrap_add);
+  if (!(address_counter & 0x2000)) {
+    address += (scanline_counter & 0x7);
+  }
+
   if (p_video->is_shadow_displayed) {
     /* TODO: won't display correctly for ANDY / HAZEL if they are paged in. */
     return p_video->p_shadow_mem[address];
@@ -294,18 +326,34 @@ video_is_at_vsync_lower(struct video_struct* p_video) {
   return 0;
 }
 
+static int
+video_is_observed(struct video_struct* p_video) {
+  /* Go active a couple of frames (at 2MHz ticks) early, so that the first
+   * observed frame is completely rendered.
+   */
+  uint64_t lead_ticks = (k_video_us_per_vsync * 2 * 2);
+  uint64_t ticks = timing_get_total_timer_ticks(p_video->p_timing);
+
+  if (p_video->first_observed_ticks <= lead_ticks) {
+    return 1;
+  }
+  return (ticks >= (p_video->first_observed_ticks - lead_ticks));
+}
+
 static void
 video_check_go_inactive(struct video_struct* p_video) {
   assert(!p_video->externally_clocked);
 
   assert(p_video->is_rendering_active);
 
-  /* If we're in fast mode, give rendering and painting a rest after each
-   * paint.
+  /* If we're in fast mode, or running faster than real time, give rendering
+   * and painting a rest after each paint.
    * We'll get prodded to start again by the 50Hz real time tick, which will
    * get noticed in video_timer_fired().
    */
-  if (!*p_video->p_fast_flag || p_video->has_paint_timer_triggered) {
+  if (video_is_observed(p_video) &&
+      ((!*p_video->p_fast_flag && !p_video->is_paint_throttled) ||
+       p_video->has_paint_timer_triggered)) {
     return;
   }
 
@@ -331,6 +379,11 @@ video_check_go_active(struct video_struct* p_video) {
     return;
   }
 
+  /* Unobserved, only the CRTC timing needs to run, not the rendering. */
+  if (!video_is_observed(p_video)) {
+    return;
+  }
+
   if ((p_video->paint_start_cycles > 0) &&
       !p_video->has_paint_timer_triggered) {
     return;
@@ -425,7 +478,7 @@ video_set_vsync_lower_state(struct video_struct* p_video) {
     via_set_CA1(p_system_via, 0);
   }
 
-  teletext_VSYNC_changed(p_video->p_teletext, 0);
+  render_teletext_VSYNC_changed(p_video->p_render, 0);
 
   p_video->last_vsync_lower_ticks =
       timing_get_total_timer_ticks(p_video->p_timing);
@@ -565,7 +618,7 @@ video_advance_crtc_timing(struct video_struct* p_video) {
       func_render = func_render_blank;
       p_video->address_counter_next_row = p_video->address_counter;
       if (p_video->display_enable_vert) {
-        teletext_DISPMTG_changed(p_video->p_teletext, 0);
+        render_teletext_DISPMTG_changed(p_render, 0);
       }
     }
     if (check_vsync_at_half_r0 &&
@@ -721,9 +774,9 @@ check_r7:
        * 0..2..4.. for odd and even frames, and inform the SAA5050 differently
        * for interlace odd frames.
        */
-      teletext_RA_changed(p_video->p_teletext, p_video->is_odd_interlace_frame);
+      render_teletext_RA_changed(p_render, p_video->is_odd_interlace_frame);
     } else {
-      teletext_RA_changed(p_video->p_teletext, p_video->scanline_counter);
+      render_teletext_RA_changed(p_render, p_video->scanline_counter);
     }
 
     render_set_RA(p_render, p_video->scanline_counter);
@@ -736,6 +789,9 @@ check_r7:
   }
 
   p_video->prev_system_ticks = curr_system_ticks;
+
+  /* Hand the queued output to the render thread, if there is one. */
+  render_flush(p_render);
 }
 
 void
@@ -1344,6 +1400,7 @@ video_create(uint8_t* p_bbc_mem,
 void
 video_destroy(struct video_struct* p_video) {
   render_set_flyback_callback(p_video->p_render, NULL, NULL);
+  util_free(p_video->p_full_frame_addresses);
   util_free(p_video);
 }
 
@@ -1507,7 +1564,8 @@ video_power_on_reset(struct video_struct* p_video) {
 
   /* Other state that needs resetting. */
   p_video->is_framing_changed_for_render = 1;
-  if ((p_video->paint_start_cycles != 0) && !p_video->is_rendering_active) {
+  if (((p_video->paint_start_cycles != 0) || !video_is_observed(p_video)) &&
+      !p_video->is_rendering_active) {
     /* Nothing. */
   } else {
     /* TODO: default these next two to 0 and change unit test? */
@@ -1524,6 +1582,16 @@ video_power_on_reset(struct video_struct* p_video) {
   video_update_timer(p_video);
 }
 
+void
+video_set_paint_throttled(struct video_struct* p_video, int is_throttled) {
+  p_video->is_paint_throttled = is_throttled;
+}
+
+void
+video_set_first_observed_ticks(struct video_struct* p_video, uint64_t ticks) {
+  p_video->first_observed_ticks = ticks;
+}
+
 uint64_t
 video_get_num_vsyncs(struct video_struct* p_video) {
   return p_video->num_vsyncs;
@@ -1574,12 +1642,67 @@ video_apply_wall_time_delta(struct video_struct* p_video, uint64_t delta) {
   video_do_paint(p_video);
 }
 
+static uint32_t*
+video_get_full_frame_addresses(struct video_struct* p_video,
+                               uint32_t crtc_start_address,
+                               uint32_t num_rows,
+                               uint32_t num_cols,
+                               uint32_t screen_wrap_add) {
+  uint32_t i_rows;
+  uint32_t i_cols;
+  uint32_t size;
+  uint32_t* p_addresses = p_video->p_full_frame_addresses;
+
+  if ((p_addresses != NULL) &&
+      (crtc_start_address == p_video->full_frame_start_address) &&
+      (num_rows == p_video->full_frame_num_rows) &&
+      (num_cols == p_video->full_frame_num_cols) &&
+      (screen_wrap_add == p_video->full_frame_screen_wrap_add)) {
+    return p_addresses;
+  }
+
+  size = (num_rows * num_cols);
+  if ((p_addresses == NULL) || (size > p_video->full_frame_addresses_size)) {
+    /* Size for the largest possible screen so this only happens once. */
+    p_video->full_frame_addresses_size = (256 * 256);
+    util_free(p_addresses);
+    p_addresses = util_malloc(p_video->full_frame_addresses_size *
+                              sizeof(uint32_t));
+    p_video->p_full_frame_addresses = p_addresses;
+  }
+
+  for (i_rows = 0; i_rows < num_rows; ++i_rows) {
+    uint32_t crtc_line_address = (crtc_start_address + (i_rows * num_cols));
+    for (i_cols = 0; i_cols < num_cols; ++i_cols) {
+      uint32_t address;
+      uint32_t scanline_mask = 0x7;
+      crtc_line_address &= 0x3FFF;
+      address = video_get_data_address(p_video,
+                                       crtc_line_address,
+                                       screen_wrap_add);
+      if (crtc_line_address & 0x2000) {
+        scanline_mask = 0;
+      }
+      *p_addresses++ = (address | (scanline_mask << 16));
+      crtc_line_address++;
+    }
+  }
+
+  p_video->full_frame_start_address = crtc_start_address;
+  p_video->full_frame_num_rows = num_rows;
+  p_video->full_frame_num_cols = num_cols;
+  p_video->full_frame_screen_wrap_add = screen_wrap_add;
+
+  return p_video->p_full_frame_addresses;
+}
+
 void
 video_render_full_frame(struct video_struct* p_video) {
   uint32_t i_cols;
   uint32_t i_lines;
   uint32_t i_rows;
-  uint32_t crtc_line_address;
+  uint32_t* p_addresses;
+  uint8_t* p_mem;
 
   struct render_struct* p_render = p_video->p_render;
   void (*func_render_data)(struct render_struct*, uint8_t) =
@@ -1625,6 +1748,20 @@ video_render_full_frame(struct video_struct* p_video) {
     num_pre_cols = (horiz_total - p_regs[k_crtc_reg_horiz_position]);
   }
 
+  /* The screen addresses only change with the registers, so the inner loop is
+   * just a lookup.
+   */
+  p_addresses = video_get_full_frame_addresses(p_video,
+                                               crtc_start_address,
+                                               num_rows,
+                                               num_cols,
+                                               screen_wrap_add);
+  if (p_video->is_shadow_displayed) {
+    p_mem = p_video->p_shadow_mem;
+  } else {
+    p_mem = p_video->p_bbc_mem;
+  }
+
   render_vsync(p_render);
   teletext_VSYNC_changed(p_teletext, 0);
 
@@ -1633,7 +1770,6 @@ video_render_full_frame(struct video_struct* p_video) {
   }
   for (i_rows = 0; i_rows < num_rows; ++i_rows) {
     for (i_lines = 0; i_lines < num_lines; ++i_lines) {
-      crtc_line_address = (crtc_start_address + (i_rows * num_cols));
       for (i_cols = 0; i_cols < num_pre_cols; ++i_cols) {
         func_render_blank(p_render, 0x00);
       }
@@ -1643,19 +1779,15 @@ video_render_full_frame(struct video_struct* p_video) {
         }
       } else {
         for (i_cols = 0; i_cols < num_cols; ++i_cols) {
-          uint8_t data;
-          crtc_line_address &= 0x3FFF;
-          data = video_read_data_byte(p_video,
-                                      crtc_line_address,
-                                      i_lines,
-                                      screen_wrap_add);
-          func_render_data(p_render, data);
-          crtc_line_address++;
+          uint32_t entry = p_addresses[i_cols];
+          uint32_t address = ((entry & 0xFFFF) + (i_lines & (entry >> 16)));
+          func_render_data(p_render, p_mem[address]);
         }
       }
       (void) render_hsync(p_render, hsync_pulse_ticks);
       teletext_DISPMTG_changed(p_teletext, 0);
     }
+    p_addresses += num_cols;
   }
 }
 
@@ -1675,30 +1807,15 @@ video_serial_ula_written_hack(struct video_struct* p_video, uint8_t val) {
 
 static void
 video_update_real_color(struct video_struct* p_video, uint8_t index) {
-  uint32_t color;
-
   uint8_t rgbf = p_video->ula_palette[index];
 
   /* The actual color displayed depends on the flash bit. */
   if ((rgbf & 0x8) && video_get_flash(p_video)) {
     rgbf ^= 0x7;
   }
-  /* Alpha. */
-  color = 0xff000000;
-  /* Red. */
-  if (rgbf & 0x1) {
-    color |= 0x00ff0000;
-  }
-  /* Green. */
-  if (rgbf & 0x2) {
-    color |= 0x0000ff00;
-  }
-  /* Blue. */
-  if (rgbf & 0x4) {
-    color |= 0x000000ff;
-  }
 
-  render_set_palette(p_video->p_render, index, color);
+  /* The renderer converts to its pixel format. */
+  render_set_palette(p_video->p_render, index, (rgbf & 0x7));
 }
 
 static void
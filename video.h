@@ -34,6 +34,13 @@ void video_shadow_mode_updated(struct video_struct* p_video,
                                int is_shadow_displayed);
 
 void video_power_on_reset(struct video_struct* p_video);
+void video_set_paint_throttled(struct video_struct* p_video, int is_throttled);
+/* For headless runs: frames before this tick count are never looked at, so
+ * the CRTC can run without rendering until shortly before. UINT64_MAX means
+ * frames are never looked at.
+ */
+void video_set_first_observed_ticks(struct video_struct* p_video,
+                                    uint64_t ticks);
 
 uint64_t video_get_num_vsyncs(struct video_struct* p_video);
 uint64_t video_get_num_crtc_advances(struct video_struct* p_video);